@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Compare the bytecode vm with the tree walking evaluator on the math
+# library, calls between lambdas and the examples, best of five runs in
+# milliseconds.
+#
+# usage: bench/vm.sh [path to lispy]
+#
+
+cd "$(dirname "$0")/.."
+BIN=${1:-./bin/lispy}
+
+# The settings file is loaded as a source file, it needs the extension
+DIR=$(mktemp -d)
+OFF="$DIR/novm.lspy"
+echo '(set "vm" 0)' > "$OFF"
+
+best() {
+    b=
+    for i in 1 2 3 4 5; do
+        s=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        t=$(( ($(date +%s%N) - s) / 1000000 ))
+        if [ -z "$b" ] || [ "$t" -lt "$b" ]; then b=$t; fi
+    done
+    echo "$b"
+}
+
+printf "%-30s %8s %8s\n" "" "vm" "tree"
+for f in bench/math.lspy bench/calls.lspy examples/*.lspy; do
+    vm=$(best "$BIN" "$f")
+    tree=$(best env LISPY_DEFAULT="$OFF" "$BIN" "$f")
+    printf "%-30s %8s %8s\n" "$f" "$vm" "$tree"
+done
+
+rm -rf "$DIR"
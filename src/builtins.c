@@ -33,6 +33,9 @@
 #include "builtins.h"
 #include "version.h"
 #include "config.h"
+#include "gc.h"
+#include "vm.h"
+#include "fold.h"
 
 lval* builtin_head(lenv* e, lval* a)
 {
@@ -41,11 +44,8 @@ lval* builtin_head(lenv* e, lval* a)
     LASSERT_TYPE("head", a, 0, LVAL_QEXPR);
     LASSERT_NOT_EMPTY("head", a, 0);
 
-    lval* v = lval_take(a, 0);
-
-    while (v->count > 1) {
-        lval_del(lval_pop(v, 1));
-    }
+    lval* v = lval_slice(LCELL(a)[0], 0, 1);
+    lval_del(a);
     return v;
 }
 
@@ -56,9 +56,10 @@ lval* builtin_tail(lenv* e, lval* a)
     LASSERT_TYPE("tail", a, 0, LVAL_QEXPR);
     LASSERT_NOT_EMPTY("tail", a, 0);
 
-    lval* v = lval_take(a, 0);
-
-    lval_del(lval_pop(v, 0));
+    /* A view past the first cell, nothing is copied */
+    lval* l = LCELL(a)[0];
+    lval* v = lval_slice(l, 1, LCOUNT(l));
+    lval_del(a);
     return v;
 }
 
@@ -80,6 +81,7 @@ lval* builtin_cons(lenv* e, lval* a)
 
 lval* builtin_list(lenv* e, lval* a)
 {
+    /* The argument list is built fresh for every call, retag it in place */
     a->type = LVAL_QEXPR;
     return a;
 }
@@ -89,20 +91,19 @@ lval* builtin_eval(lenv* e, lval* a)
     LASSERT_NUM("eval", a, 1);
     LASSERT_TYPE("eval", a, 0, LVAL_QEXPR);
 
-    lval* x = lval_take(a, 0);
-    x->type = LVAL_SEXPR;
-    return lval_eval(e, x);
+    /* The result of eval is that of the expression, a tail position */
+    return lval_tail(e, lval_take(a, 0));
 }
 
 lval* builtin_join(lenv* e, lval* a)
 {
-    for (int i = 0; i < a->count; i++) {
+    for (int i = 0; i < LCOUNT(a); i++) {
         LASSERT_TYPE("join", a, i, LVAL_QEXPR);
     }
 
-    lval* x = lval_pop(a, 0);
+    lval* x = lval_unshare(lval_pop(a, 0));
 
-    while (a->count) {
+    while (LCOUNT(a)) {
         x = lval_join(x, lval_pop(a, 0));
     }
 
@@ -110,54 +111,356 @@ lval* builtin_join(lenv* e, lval* a)
     return x;
 }
 
-lval* builtin_cmp(lenv* e, lval* a, char* op)
+/**
+ * Vector operations. They take Q-Expressions as well, which are
+ * copied only when shared.
+ */
+static int seq_len(lval* l)
 {
-    LASSERT_NUM(op, a, 2);
-    int r;
-    if (strcmp(op, "==") == 0) {
-        r = lval_eq(a->cell[0], a->cell[1]);
+    return LTYPE(l) == LVAL_VEC ? lvec_count(l) : LCOUNT(l);
+}
+
+lval* builtin_vec(lenv* e, lval* a)
+{
+    LASSERT_NUM("vec", a, 1);
+    LASSERT_TYPE("vec", a, 0, LVAL_QEXPR);
+
+    lval* v = lvec_from_expr(LCELL(a)[0]);
+    lval_del(a);
+    return v;
+}
+
+lval* builtin_unvec(lenv* e, lval* a)
+{
+    LASSERT_NUM("unvec", a, 1);
+    LASSERT_TYPE("unvec", a, 0, LVAL_VEC);
+
+    lval* q = lvec_to_qexpr(LCELL(a)[0]);
+    lval_del(a);
+    return q;
+}
+
+lval* builtin_len(lenv* e, lval* a)
+{
+    LASSERT_NUM("len", a, 1);
+    LASSERT_SEQ("len", a, 0);
+
+    int n = seq_len(LCELL(a)[0]);
+    lval_del(a);
+    return lval_num(n);
+}
+
+lval* builtin_nth(lenv* e, lval* a)
+{
+    LASSERT_NUM("nth", a, 2);
+    LASSERT_TYPE("nth", a, 0, LVAL_NUM);
+    LASSERT_SEQ("nth", a, 1);
+
+    long n = LNUM(LCELL(a)[0]);
+    lval* l = LCELL(a)[1];
+    LASSERT(a, n >= 0 && n < seq_len(l), "List out of bounds");
+
+    lval* x = LTYPE(l) == LVAL_VEC ? lvec_nth(l, n) : LCELL(l)[n];
+    x = lval_copy(x);
+    lval_del(a);
+    return x;
+}
+
+lval* builtin_assoc(lenv* e, lval* a)
+{
+    LASSERT_NUM("assoc", a, 3);
+    LASSERT_TYPE("assoc", a, 0, LVAL_NUM);
+    LASSERT_SEQ("assoc", a, 2);
+
+    long n = LNUM(LCELL(a)[0]);
+    LASSERT(a, n >= 0 && n < seq_len(LCELL(a)[2]), "List out of bounds");
+
+    lval* l = lval_pop(a, 2);
+    lval* x = lval_pop(a, 1);
+    lval_del(a);
+
+    if (LTYPE(l) == LVAL_VEC) {
+        lval* v = lvec_assoc(l, n, x);
+        lval_del(l);
+        return v;
     }
-    if (strcmp(op, "!=") == 0) {
-        r = !lval_eq(a->cell[0], a->cell[1]);
+
+    l = lval_unshare(l);
+    lval_del(LCELL(l)[n]);
+    LCELL(l)[n] = x;
+    return l;
+}
+
+lval* builtin_push(lenv* e, lval* a)
+{
+    LASSERT_NUM("push", a, 2);
+    LASSERT_SEQ("push", a, 1);
+
+    lval* l = lval_pop(a, 1);
+    lval* x = lval_take(a, 0);
+
+    if (LTYPE(l) == LVAL_VEC) {
+        lval* v = lvec_push(l, x);
+        lval_del(l);
+        return v;
     }
-    if (strcmp(op, "&&") == 0) {
+
+    return lval_add(lval_unshare(l), x);
+}
+
+lval* builtin_slice(lenv* e, lval* a)
+{
+    LASSERT_NUM("slice", a, 3);
+    LASSERT_TYPE("slice", a, 0, LVAL_NUM);
+    LASSERT_TYPE("slice", a, 1, LVAL_NUM);
+    LASSERT_SEQ("slice", a, 2);
+
+    long start = LNUM(LCELL(a)[0]);
+    long end = LNUM(LCELL(a)[1]);
+    lval* l = LCELL(a)[2];
+    LASSERT(a, start >= 0 && start <= end && end <= seq_len(l), "List out of bounds");
+
+    lval* x = LTYPE(l) == LVAL_VEC ? lvec_slice(l, start, end) : lval_slice(l, start, end);
+    lval_del(a);
+    return x;
+}
+
+lval* builtin_concat(lenv* e, lval* a)
+{
+    for (int i = 0; i < LCOUNT(a); i++) {
+        LASSERT_SEQ("concat", a, i);
+    }
+    LASSERT(a, LCOUNT(a) > 0, "Function 'concat' passed no arguments.");
+
+    lval* x = lval_pop(a, 0);
+
+    /* The first argument decides the type of the result */
+    while (LCOUNT(a)) {
+        lval* y = lval_pop(a, 0);
+
+        if (LTYPE(x) == LVAL_VEC) {
+            if (LTYPE(y) != LVAL_VEC) {
+                lval* v = lvec_from_expr(y);
+                lval_del(y);
+                y = v;
+            }
+            lval* v = lvec_concat(x, y);
+            lval_del(x);
+            lval_del(y);
+            x = v;
+        } else {
+            if (LTYPE(y) == LVAL_VEC) {
+                lval* q = lvec_to_qexpr(y);
+                lval_del(y);
+                y = q;
+            }
+            x = lval_join(lval_unshare(x), y);
+        }
     }
+
     lval_del(a);
-    return lval_bool(r);
+    return x;
+}
+
+/* Operator names, as reported in errors */
+static char* op_names[] = {
+    [ARITH_ADD] = "+", [ARITH_SUB] = "-", [ARITH_MUL] = "*", [ARITH_DIV] = "/",
+    [ARITH_MOD] = "%", [ARITH_POW] = "^", [ARITH_MIN] = "min", [ARITH_MAX] = "max",
+    [ORD_GT] = ">", [ORD_LT] = "<", [ORD_GE] = ">=", [ORD_LE] = "<=",
+    [CMP_EQ] = "==", [CMP_NE] = "!="
+};
+
+lval* builtin_cmp(lenv* e, lval* a, int op)
+{
+    lval* r = builtin_cmp_v(e, LCOUNT(a), LCELL(a), op);
+    lval_del(a);
+    return r;
 }
 
-lval* builtin_eq(lenv* e, lval* a)
+lval* builtin_cmp_v(lenv* e, int argc, lval** argv, int op)
 {
-    return builtin_cmp(e, a, "==");
+    if (argc != 2) {
+        return lval_err("Function '%s' passed incorrect number for arguments. Got %i, expected %i.",
+                op_names[op], argc, 2);
+    }
+
+    int r = lval_eq(argv[0], argv[1]);
+    return lval_bool(op == CMP_EQ ? r : !r);
 }
 
-lval* builtin_ne(lenv* e, lval* a)
+/**
+ * Special forms, their arguments come in unevaluated and each evaluates
+ * only what it needs. An expression in tail position of the form is
+ * handed back to the evaluator with lval_tail.
+ */
+static lval* builtin_value(lenv* e, lval* x)
 {
-    return builtin_cmp(e, a, "!=");
+    return LTYPE(x) == LVAL_SEXPR ? lval_tail(e, x) : lval_eval(e, x);
 }
 
-lval* builtin_and(lenv* e, lval* a)
+/* (step v) evaluates the value v of a branch as code if it is a Q-Expression */
+static lval* builtin_branch_then(lenv* e, lval* a)
+{
+    lval* v = lval_take(a, 0);
+    return LTYPE(v) == LVAL_QEXPR ? lval_tail(e, v) : v;
+}
+
+static lval builtin_branch_step = {
+    .type = LVAL_FUN, .is_builtin = 1, .refs = LVAL_IMMORTAL,
+    .as.fun.builtin = builtin_branch_then
+};
+
+/**
+ * A Q-Expression as a branch is evaluated as an S-Expression the way if
+ * always did. Any other branch is evaluated for its value, and a value
+ * that is a Q-Expression is evaluated as code in turn, no matter if the
+ * branch was a call or a name. An S-Expression is evaluated by the
+ * evaluator, as (step x), so it does not recurse on the C stack.
+ */
+static lval* builtin_branch(lenv* e, lval* x)
+{
+    if (LTYPE(x) == LVAL_QEXPR) { return lval_tail(e, x); }
+    if (LTYPE(x) == LVAL_SEXPR) {
+        lval* r = lval_sexpr();
+        lval_add(r, &builtin_branch_step);
+        return lval_tail(e, lval_add(r, x));
+    }
+
+    lval* v = lval_eval(e, x);
+    return LTYPE(v) == LVAL_QEXPR ? lval_tail(e, v) : v;
+}
+
+/**
+ * A condition or operand that is an S-Expression is not evaluated on
+ * the C stack, deep recursion through it would overflow that. The form
+ * hands back (step x {rest}) instead, a call of a plain builtin with x
+ * evaluated by the evaluator like any other argument, within its depth
+ * limit, and the cells still to come quoted.
+ */
+static lval* builtin_defer(lenv* e, lval* step, lval* x, lval* rest)
+{
+    rest = lval_unshare(rest);
+    rest->type = LVAL_QEXPR;
+    lval* r = lval_sexpr();
+    lval_add(r, step);
+    lval_add(r, x);
+    return lval_tail(e, lval_add(r, rest));
+}
+
+/* Take the truth of condition c into *pick, returns an error or NULL */
+static lval* builtin_truth(lval* c, char* func, int* pick)
+{
+    if (LTYPE(c) == LVAL_ERR) { return c; }
+
+    lval* err = NULL;
+    if (LTYPE(c) == LVAL_BOOL) {
+        *pick = LBOOL(c);
+    } else if (LTYPE(c) == LVAL_NUM) {
+        *pick = LNUM(c) > 0;
+    } else {
+        err = lval_err("Function '%s' cannot compare on %s. %s or %s expected",
+                func, ltype_name(LTYPE(c)), ltype_name(LVAL_BOOL), ltype_name(LVAL_NUM));
+    }
+    lval_del(c);
+    return err;
+}
+
+/* Check operand x of and/or is a boolean, returns an error or NULL */
+static lval* builtin_operand(lval* x, char* func, int i, int* r)
 {
-    LASSERT_NUM("&&", a, 2);
-    LASSERT_TYPE("&&", a, 0, LVAL_BOOL);
-    LASSERT_TYPE("&&", a, 1, LVAL_BOOL);
+    if (LTYPE(x) == LVAL_BOOL) {
+        *r = LBOOL(x);
+        lval_del(x);
+        return NULL;
+    }
+
+    lval* err = LTYPE(x) == LVAL_ERR ? x : lval_err(
+            "Function '%s' passed incorrect type for argument %i. Got %s, expected %s.",
+            func, i, ltype_name(LTYPE(x)), ltype_name(LVAL_BOOL));
+    if (err != x) { lval_del(x); }
+    return err;
+}
 
-    int r = a->cell[0]->bool && a->cell[1]->bool;
+static lval* builtin_logic_then(lenv* e, lval* a);
+
+static lval builtin_logic_step = {
+    .type = LVAL_FUN, .is_builtin = 1, .refs = LVAL_IMMORTAL,
+    .as.fun.builtin = builtin_logic_then
+};
+
+/* Names of the logic forms, the odd ones stop at the first true operand */
+static char* logic_names[] = { "&&", "||", "and", "or" };
+
+/**
+ * Evaluate booleans in order until one of them is the stop value of
+ * form op, a is what is left of them from operand first on.
+ */
+static lval* builtin_logic(lenv* e, lval* a, int first, int op)
+{
+    char* func = logic_names[op];
+    int stop = op & 1;
+
+    for (int i = first; LCOUNT(a) > 0; i++) {
+        lval* x = lval_pop(a, 0);
+        if (LTYPE(x) == LVAL_SEXPR) {
+            lval* r = lval_sexpr();
+            lval_add(r, lval_num(i));
+            lval_add(r, lval_num(op));
+            return builtin_defer(e, &builtin_logic_step, x, lval_join(r, a));
+        }
+
+        int r;
+        lval* err = builtin_operand(lval_eval(e, x), func, i, &r);
+        if (err || r == stop) {
+            lval_del(a);
+            return err ? err : lval_bool(stop);
+        }
+    }
 
     lval_del(a);
-    return lval_bool(r);
+    return lval_bool(!stop);
+}
+
+/* (step x {i op rest}) goes on after operand i of and/or was x */
+static lval* builtin_logic_then(lenv* e, lval* a)
+{
+    lval* x = lval_pop(a, 0);
+    lval* rest = lval_unshare(lval_take(a, 0));
+    int i = LNUM(LCELL(rest)[0]);
+    int op = LNUM(LCELL(rest)[1]);
+    int stop = op & 1;
+
+    int r;
+    lval* err = builtin_operand(x, logic_names[op], i, &r);
+    if (err || r == stop) {
+        lval_del(rest);
+        return err ? err : lval_bool(stop);
+    }
+
+    lval_del(lval_pop(rest, 0));
+    lval_del(lval_pop(rest, 0));
+    return builtin_logic(e, rest, i + 1, op);
+}
+
+lval* builtin_and(lenv* e, lval* a)
+{
+    return builtin_logic(e, a, 0, 0);
 }
 
 lval* builtin_or(lenv* e, lval* a)
 {
-    LASSERT_NUM("||", a, 2);
-    LASSERT_TYPE("||", a, 0, LVAL_BOOL);
-    LASSERT_TYPE("||", a, 1, LVAL_BOOL);
+    return builtin_logic(e, a, 0, 1);
+}
 
-    int r = a->cell[0]->bool || a->cell[1]->bool;
+/* and and or are && and || under the name they report errors with */
+lval* builtin_and_word(lenv* e, lval* a)
+{
+    return builtin_logic(e, a, 0, 2);
+}
 
-    lval_del(a);
-    return lval_bool(r);
+lval* builtin_or_word(lenv* e, lval* a)
+{
+    return builtin_logic(e, a, 0, 3);
 }
 
 lval* builtin_xor(lenv* e, lval* a)
@@ -166,7 +469,7 @@ lval* builtin_xor(lenv* e, lval* a)
     LASSERT_TYPE("xor", a, 0, LVAL_BOOL);
     LASSERT_TYPE("xor", a, 1, LVAL_BOOL);
 
-    int r = a->cell[0]->bool ^ a->cell[1]->bool;
+    int r = LBOOL(LCELL(a)[0]) ^ LBOOL(LCELL(a)[1]);
     lval_del(a);
     return lval_bool(r);
 }
@@ -176,44 +479,502 @@ lval* builtin_not(lenv* e, lval* a)
     LASSERT_NUM("!", a, 1);
     LASSERT_TYPE("!", a, 0, LVAL_BOOL);
 
-    int r = a->cell[0]->bool;
+    int r = LBOOL(LCELL(a)[0]);
     lval_del(a);
     return lval_bool(!r);
 }
 
+/**
+ * if and when given the value c of their condition pick from the
+ * branches in b, when has only the one.
+ */
+static lval* builtin_pick(lenv* e, lval* c, lval* b)
+{
+    char* func = LCOUNT(b) == 2 ? "if" : "when";
+
+    int pick;
+    lval* err = builtin_truth(c, func, &pick);
+    if (err || (!pick && LCOUNT(b) == 1)) {
+        lval_del(b);
+        return err ? err : lval_qexpr();
+    }
+
+    return builtin_branch(e, lval_take(b, pick ? 0 : 1));
+}
+
+/* (step c {branches}) goes on after the condition of if or when was c */
+static lval* builtin_pick_then(lenv* e, lval* a)
+{
+    lval* c = lval_pop(a, 0);
+    return builtin_pick(e, c, lval_unshare(lval_take(a, 0)));
+}
+
+static lval builtin_pick_step = {
+    .type = LVAL_FUN, .is_builtin = 1, .refs = LVAL_IMMORTAL,
+    .as.fun.builtin = builtin_pick_then
+};
+
+static lval* builtin_test(lenv* e, lval* a)
+{
+    lval* c = lval_pop(a, 0);
+    if (LTYPE(c) == LVAL_SEXPR) { return builtin_defer(e, &builtin_pick_step, c, a); }
+    return builtin_pick(e, lval_eval(e, c), a);
+}
+
 lval* builtin_if(lenv* e, lval* a)
 {
     LASSERT_NUM("if", a, 3);
-    if (a->cell[0]->type != LVAL_BOOL && a->cell[0]->type != LVAL_NUM) {
+    return builtin_test(e, a);
+}
+
+lval* builtin_when(lenv* e, lval* a)
+{
+    LASSERT_NUM("when", a, 2);
+    return builtin_test(e, a);
+}
+
+static lval* builtin_cond_then(lenv* e, lval* a);
+
+static lval builtin_cond_step = {
+    .type = LVAL_FUN, .is_builtin = 1, .refs = LVAL_IMMORTAL,
+    .as.fun.builtin = builtin_cond_then
+};
+
+/**
+ * (cond {condition value} ...) evaluates the value of the first clause
+ * whose condition holds, a Q-Expression value is not evaluated any
+ * further. Given a condition and two branches it is an if.
+ */
+lval* builtin_cond(lenv* e, lval* a)
+{
+    if (LCOUNT(a) == 3 && LTYPE(LCELL(a)[0]) != LVAL_QEXPR) { return builtin_if(e, a); }
+
+    for (int i = 0; i < LCOUNT(a); i++) {
+        lval* c = LCELL(a)[i];
+        LASSERT(a, LTYPE(c) == LVAL_QEXPR && LCOUNT(c) == 2,
+                "Function 'cond' passed incorrect clause for argument %i. Expected {condition value}.", i);
+    }
+
+    /* The clauses may be shared with the code, they are only read */
+    while (LCOUNT(a) > 0) {
+        lval* c = lval_pop(a, 0);
+        lval* x = lval_copy(LCELL(c)[0]);
+        lval* v = lval_copy(LCELL(c)[1]);
+        lval_del(c);
+        if (LTYPE(x) == LVAL_SEXPR) {
+            return builtin_defer(e, &builtin_cond_step, x, lval_join(lval_add(lval_qexpr(), v), a));
+        }
+
+        int pick;
+        lval* err = builtin_truth(lval_eval(e, x), "cond", &pick);
+        if (err || pick) {
+            lval_del(a);
+            if (err) { lval_del(v); }
+            return err ? err : builtin_value(e, v);
+        }
+        lval_del(v);
+    }
+
+    lval_del(a);
+    return lval_err("No Selection Found");
+}
+
+/* (step x {value clauses}) goes on after a condition of cond was x */
+static lval* builtin_cond_then(lenv* e, lval* a)
+{
+    lval* x = lval_pop(a, 0);
+    lval* rest = lval_unshare(lval_take(a, 0));
+
+    int pick;
+    lval* err = builtin_truth(x, "cond", &pick);
+    if (err || pick) {
+        if (err) { lval_del(rest); }
+        return err ? err : builtin_value(e, lval_take(rest, 0));
+    }
+
+    lval_del(lval_pop(rest, 0));
+    rest->type = LVAL_SEXPR;
+    return builtin_cond(e, rest);
+}
+
+/**
+ * Loops. A body, and the condition of while, is evaluated as an
+ * S-Expression on every iteration, whether given as a Q-Expression or
+ * an S-Expression. With the vm on it is compiled once up front, the
+ * names of the loop taking the place of formals. The variables of
+ * dotimes, doseq and loop live in a single frame of their own, made
+ * once, whose values are replaced in place from one iteration to the
+ * next.
+ */
+static lval* builtin_run(lenv* e, lval* x)
+{
+    if (LTYPE(x) == LVAL_SEXPR || LTYPE(x) == LVAL_QEXPR) { return lval_eval_sexpr(e, x); }
+    return lval_eval(e, lval_copy(x));
+}
+
+/**
+ * The constants of the code are only rooted while it runs, they stay on
+ * the root stack from here until builtin_release so that a collection in
+ * between, while the condition or another body runs, leaves them be.
+ */
+static lcode* builtin_compile(lval* names, lval* x)
+{
+    lcode* code = NULL;
+    if (get_vm() && (LTYPE(x) == LVAL_SEXPR || LTYPE(x) == LVAL_QEXPR)) {
+        lval* body = lval_resolve(names, lval_copy(x));
+        code = vm_compile(body);
+        lval_del(body);
+    }
+
+    gc_push(code ? code->consts : NULL);
+    return code;
+}
+
+static lval* builtin_iterate(lenv* e, lval* x, lcode* code)
+{
+    return code ? lval_eval_code(e, code) : builtin_run(e, x);
+}
+
+static void builtin_release(lcode* code)
+{
+    gc_pop(1);
+    if (code) { vm_release(code); }
+}
+
+/* A frame for n loop variables, inside e */
+static lenv* builtin_frame(lenv* e, int n)
+{
+    lenv* f = lenv_new();
+    f->syms = malloc(sizeof(char*) * n);
+    f->vals = malloc(sizeof(lval*) * n);
+    f->par = e;
+    e->refs++;
+    gc_push_env(f);
+    return f;
+}
+
+static void builtin_frame_del(lenv* f)
+{
+    gc_pop_env();
+    lenv_del(f);
+}
+
+static void builtin_frame_set(lenv* f, int i, lval* v)
+{
+    lval_del(f->vals[i]);
+    f->vals[i] = v;
+}
+
+/* Check a {name value} binding, the error or NULL */
+static lval* builtin_binding(lval* b, char* func, int pairs)
+{
+    if (LTYPE(b) != LVAL_QEXPR || (pairs ? LCOUNT(b) % 2 : LCOUNT(b) != 2)) {
+        return lval_err("Function '%s' passed incorrect bindings. Expected {name value%s}.",
+                func, pairs ? " ..." : "");
+    }
+    for (int i = 0; i < LCOUNT(b); i += 2) {
+        if (LTYPE(LCELL(b)[i]) != LVAL_SYM) {
+            return lval_err("Function '%s' cannot bind non-symbol. Got %s, expected %s.",
+                    func, ltype_name(LTYPE(LCELL(b)[i])), ltype_name(LVAL_SYM));
+        }
+        lenv_local(LCELL(b)[i]);
+    }
+    return NULL;
+}
+
+lval* builtin_while(lenv* e, lval* a)
+{
+    LASSERT_NUM("while", a, 2);
+
+    lval* names = lval_qexpr();
+    lcode* test = builtin_compile(names, LCELL(a)[0]);
+    lcode* code = builtin_compile(names, LCELL(a)[1]);
+    lval_del(names);
+
+    /* The value of the body is let go of before the condition runs again */
+    lval* err = NULL;
+    for (;;) {
+        int pick;
+        err = builtin_truth(builtin_iterate(e, LCELL(a)[0], test), "while", &pick);
+        if (err || !pick) { break; }
+
+        lval* r = builtin_iterate(e, LCELL(a)[1], code);
+        if (LTYPE(r) == LVAL_ERR) {
+            err = r;
+            break;
+        }
+        lval_del(r);
+    }
+
+    builtin_release(code);
+    builtin_release(test);
+    lval_del(a);
+    return err ? err : lval_sexpr();
+}
+
+/* (dotimes {i n} body) runs body with i from 0 up to n */
+lval* builtin_dotimes(lenv* e, lval* a)
+{
+    LASSERT_NUM("dotimes", a, 2);
+    lval* err = builtin_binding(LCELL(a)[0], "dotimes", 0);
+    if (err) {
+        lval_del(a);
+        return err;
+    }
+
+    lval* n = lval_eval(e, lval_copy(LCELL(LCELL(a)[0])[1]));
+    if (LTYPE(n) != LVAL_NUM) {
+        err = LTYPE(n) == LVAL_ERR ? n : lval_err(
+                "Function 'dotimes' passed incorrect type for count. Got %s, expected %s.",
+                ltype_name(LTYPE(n)), ltype_name(LVAL_NUM));
+        if (err != n) { lval_del(n); }
         lval_del(a);
-        return lval_err("Function 'if' cannot compare on %s. %s or %s expected",
-                ltype_name(a->cell[0]->type),
-                ltype_name(LVAL_BOOL),
-                ltype_name(LVAL_NUM));
+        return err;
     }
-    LASSERT_TYPE("if", a, 1, LVAL_QEXPR);
-    LASSERT_TYPE("if", a, 2, LVAL_QEXPR);
 
-    lval* x;
-    a->cell[1]->type = LVAL_SEXPR;
-    a->cell[2]->type = LVAL_SEXPR;
+    long count = LNUM(n);
+    lval_del(n);
 
-    if (a->cell[0]->type == LVAL_BOOL) {
-        if (a->cell[0]->bool) {
-            x = lval_eval(e, lval_pop(a, 1));
-        } else {
-            x = lval_eval(e, lval_pop(a, 2));
+    lval* names = lval_slice(LCELL(a)[0], 0, 1);
+    lcode* code = builtin_compile(names, LCELL(a)[1]);
+    lval_del(names);
+
+    lenv* f = builtin_frame(e, 1);
+    lenv_bind(f, LSYM(LCELL(LCELL(a)[0])[0]), lval_num(0));
+
+    lval* r = lval_sexpr();
+    for (long i = 0; i < count; i++) {
+        builtin_frame_set(f, 0, lval_num(i));
+        lval_del(r);
+        r = builtin_iterate(f, LCELL(a)[1], code);
+        if (LTYPE(r) == LVAL_ERR) { break; }
+    }
+
+    builtin_release(code);
+    builtin_frame_del(f);
+    lval_del(a);
+    if (LTYPE(r) == LVAL_ERR) { return r; }
+
+    lval_del(r);
+    return lval_sexpr();
+}
+
+/* (doseq {x l} body) runs body with x bound to each item of l */
+lval* builtin_doseq(lenv* e, lval* a)
+{
+    LASSERT_NUM("doseq", a, 2);
+    lval* err = builtin_binding(LCELL(a)[0], "doseq", 0);
+    if (err) {
+        lval_del(a);
+        return err;
+    }
+
+    lval* l = lval_eval(e, lval_copy(LCELL(LCELL(a)[0])[1]));
+    if (LTYPE(l) != LVAL_QEXPR && LTYPE(l) != LVAL_VEC) {
+        err = LTYPE(l) == LVAL_ERR ? l : lval_err(
+                "Function 'doseq' passed incorrect type for sequence. Got %s, expected %s or %s.",
+                ltype_name(LTYPE(l)), ltype_name(LVAL_QEXPR), ltype_name(LVAL_VEC));
+        if (err != l) { lval_del(l); }
+        lval_del(a);
+        return err;
+    }
+
+    lval* names = lval_slice(LCELL(a)[0], 0, 1);
+    lcode* code = builtin_compile(names, LCELL(a)[1]);
+    lval_del(names);
+
+    lenv* f = builtin_frame(e, 1);
+    lenv_bind(f, LSYM(LCELL(LCELL(a)[0])[0]), lval_sexpr());
+    gc_push(l);
+
+    lval* r = lval_sexpr();
+    for (int i = 0; i < seq_len(l); i++) {
+        lval* x = LTYPE(l) == LVAL_VEC ? lvec_nth(l, i) : LCELL(l)[i];
+        builtin_frame_set(f, 0, lval_copy(x));
+        lval_del(r);
+        r = builtin_iterate(f, LCELL(a)[1], code);
+        if (LTYPE(r) == LVAL_ERR) { break; }
+    }
+
+    gc_pop(1);
+    lval_del(l);
+    builtin_release(code);
+    builtin_frame_del(f);
+    lval_del(a);
+    if (LTYPE(r) == LVAL_ERR) { return r; }
+
+    lval_del(r);
+    return lval_sexpr();
+}
+
+/**
+ * (loop {name value ...} body) binds the names in order and evaluates
+ * body, which ends the loop with its value unless it ends in recur.
+ * recur binds the names to its arguments and has the body evaluated
+ * once more. It only does so in tail position of the body, where
+ * nothing is left to do after it: the body itself, the branches of if
+ * and when, an S-Expression value of cond and the last expression of
+ * do. Those are made calls of loop_next when the loop starts, recur
+ * anywhere else, or in a function called from the body, is an error.
+ * None of those positions opens a frame, so loop_next is called in the
+ * frame of its own loop, e, even with loops nested inside the body.
+ */
+static lval* builtin_next(lenv* e, lval* a);
+
+/* Its own value is what the body ends in when it recurs */
+static lval loop_next = {
+    .type = LVAL_FUN, .is_builtin = 1, .refs = LVAL_IMMORTAL,
+    .as.fun.builtin = builtin_next
+};
+
+static lval* builtin_next(lenv* e, lval* a)
+{
+    /* The arguments are moved over into the slots of the names */
+    a = lval_unshare(a);
+    for (int i = 0; i < LCOUNT(a); i++) {
+        builtin_frame_set(e, i, LCELL(a)[i]);
+    }
+    LCOUNT(a) = 0;
+    lval_del(a);
+    return &loop_next;
+}
+
+/**
+ * Whether head names the builtin b, or the lambda do when b is NULL. It
+ * has to be the global binding no other can take the place of, rebound
+ * names are left alone as if they were any other call.
+ */
+static int builtin_names(lval* head, lbuiltin b)
+{
+    if (LTYPE(head) != LVAL_SYM) { return 0; }
+
+    lval* g = fold_global(head);
+    if (g == NULL || LTYPE(g) != LVAL_FUN) { return 0; }
+    return b ? LBUILTIN(g) == b : !LBUILTIN(g) && strcmp(LSYM(head), "do") == 0;
+}
+
+/* A copy of x with recur in its tail positions made loop_next, or an error */
+static lval* builtin_tails(lval* x, int vars)
+{
+    int n = LTYPE(x) == LVAL_SEXPR || LTYPE(x) == LVAL_QEXPR ? LCOUNT(x) : 0;
+    if (n == 0) { return lval_copy(x); }
+
+    lval* head = LCELL(x)[0];
+    if (builtin_names(head, builtin_recur)) {
+        if (n - 1 != vars) {
+            return lval_err("Function 'recur' passed incorrect number for arguments. Got %i, expected %i.",
+                    n - 1, vars);
         }
-    } else {
-        if (a->cell[0]->num > 0) {
-            x = lval_eval(e, lval_pop(a, 1));
+        x = lval_dup(x);
+        lval_del(LCELL(x)[0]);
+        LCELL(x)[0] = &loop_next;
+        return x;
+    }
+
+    int cond = builtin_names(head, builtin_cond);
+    int from = n;
+    if (builtin_names(head, builtin_if) && n == 4) { from = 2; }
+    if (builtin_names(head, builtin_when) && n == 3) { from = 2; }
+    if (builtin_names(head, NULL) && LTYPE(LCELL(x)[n - 1]) == LVAL_SEXPR) { from = n - 1; }
+    if (cond) { from = 1; }
+    if (from == n) { return lval_copy(x); }
+
+    x = lval_dup(x);
+    for (int i = from; i < n; i++) {
+        lval* c = LCELL(x)[i];
+        lval* t;
+        if (!cond) {
+            t = builtin_tails(c, vars);
+        } else if (LTYPE(c) == LVAL_QEXPR && LCOUNT(c) == 2 && LTYPE(LCELL(c)[1]) == LVAL_SEXPR) {
+            t = lval_dup(c);
+            lval* v = builtin_tails(LCELL(t)[1], vars);
+            lval_del(LCELL(t)[1]);
+            LCELL(t)[1] = v;
+            if (LTYPE(v) == LVAL_ERR) { t = lval_take(t, 1); }
         } else {
-            x = lval_eval(e, lval_pop(a, 2));
+            continue;
+        }
+
+        lval_del(c);
+        LCELL(x)[i] = t;
+        if (LTYPE(t) == LVAL_ERR) { return lval_take(x, i); }
+    }
+    return x;
+}
+
+lval* builtin_loop(lenv* e, lval* a)
+{
+    LASSERT_NUM("loop", a, 2);
+    lval* b = LCELL(a)[0];
+    lval* err = builtin_binding(b, "loop", 1);
+    if (err) {
+        lval_del(a);
+        return err;
+    }
+
+    lval* body = builtin_tails(LCELL(a)[1], LCOUNT(b) / 2);
+    if (LTYPE(body) == LVAL_ERR) {
+        lval_del(a);
+        return body;
+    }
+    gc_push(body);
+
+    /* Later values see the names bound before them */
+    lenv* f = builtin_frame(e, LCOUNT(b) / 2);
+    for (int i = 0; i < LCOUNT(b); i += 2) {
+        lval* v = lval_eval(f, lval_copy(LCELL(b)[i + 1]));
+        if (LTYPE(v) == LVAL_ERR) {
+            builtin_frame_del(f);
+            gc_pop(1);
+            lval_del(body);
+            lval_del(a);
+            return v;
         }
+        lenv_bind(f, LSYM(LCELL(b)[i]), v);
+    }
+
+    lval* names = lval_qexpr();
+    for (int i = 0; i < LCOUNT(b); i += 2) {
+        lval_add(names, lval_copy(LCELL(b)[i]));
+    }
+    lcode* code = builtin_compile(names, body);
+    lval_del(names);
+
+    lval* r;
+    for (;;) {
+        r = builtin_iterate(f, body, code);
+        if (r != &loop_next) { break; }
     }
 
+    builtin_release(code);
+    builtin_frame_del(f);
+    gc_pop(1);
+    lval_del(body);
     lval_del(a);
-    return x;
+    return r;
+}
+
+/* What is left of recur are the calls loop did not take over */
+lval* builtin_recur(lenv* e, lval* a)
+{
+    lval_del(a);
+    return lval_err("Function 'recur' called outside of tail position of loop.");
+}
+
+/**
+ * (let {body}) evaluates body in a frame of its own inside e, names it
+ * binds with = are gone afterwards while those of e stay in sight.
+ */
+lval* builtin_let(lenv* e, lval* a)
+{
+    LASSERT_NUM("let", a, 1);
+    LASSERT_TYPE("let", a, 0, LVAL_QEXPR);
+
+    lenv* f = builtin_frame(e, 0);
+    lval* r = builtin_run(f, LCELL(a)[0]);
+    builtin_frame_del(f);
+    lval_del(a);
+    return r;
 }
 
 lval* builtin_init(lenv* e, lval* a)
@@ -223,10 +984,9 @@ lval* builtin_init(lenv* e, lval* a)
     LASSERT_TYPE("init", a, 0, LVAL_QEXPR);
     LASSERT_NOT_EMPTY("init", a, 0);
 
-    lval* v = lval_take(a ,0);
-
-    lval_del(lval_pop(v, v->count -1));
-
+    lval* l = LCELL(a)[0];
+    lval* v = lval_slice(l, 0, LCOUNT(l) - 1);
+    lval_del(a);
     return v;
 }
 
@@ -236,40 +996,53 @@ lval* builtin_lambda(lenv* e, lval* a)
     LASSERT_TYPE("\\", a, 0, LVAL_QEXPR);
     LASSERT_TYPE("\\", a, 1, LVAL_QEXPR);
 
-    for (int i = 0; i < a->cell[0]->count; i++) {
-        LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
+    for (int i = 0; i < LCOUNT(LCELL(a)[0]); i++) {
+        LASSERT(a, (LTYPE(LCELL(LCELL(a)[0])[i]) == LVAL_SYM),
                 "Cannot define non-symbol. Got %s, expected %s.",
-                ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
+                ltype_name(LTYPE(LCELL(LCELL(a)[0])[i])), ltype_name(LVAL_SYM));
     }
 
     lval* formals = lval_pop(a, 0);
     lval* body = lval_pop(a, 0);
     lval_del(a);
 
-    return lval_lambda(formals, body);
+    lval* f = lval_lambda(formals, lval_resolve(formals, body));
+    if (get_vm()) { LCODE(f) = vm_compile(LBODY(f)); }
+
+    /* Capture the environment the lambda is built in */
+    LENV(f)->par = e;
+    e->refs++;
+    return f;
 }
 
 lval* builtin_var(lenv* e, lval* a, char* func)
 {
     LASSERT_TYPE(func, a, 0, LVAL_QEXPR);
 
-    lval* syms = a->cell[0];
-    for (int i = 0; i < syms->count; i++) {
-        LASSERT(a, (syms->cell[i]->type == LVAL_SYM),
+    lval* syms = LCELL(a)[0];
+    for (int i = 0; i < LCOUNT(syms); i++) {
+        LASSERT(a, (LTYPE(LCELL(syms)[i]) == LVAL_SYM),
                 "Function '%s' cannot define non-symbol. Got %s, expected %s.",
-                func, ltype_name(syms->cell[i]->type), ltype_name(LVAL_SYM));
+                func, ltype_name(LTYPE(LCELL(syms)[i])), ltype_name(LVAL_SYM));
     }
 
-    LASSERT(a, (syms->count == a->count - 1),
+    LASSERT(a, (LCOUNT(syms) == LCOUNT(a) - 1),
             "Function '%s' passed to many arguments for symbols. Got %i, expected %i",
-            func, syms->count, a->count - 1);
+            func, LCOUNT(syms), LCOUNT(a) - 1);
+
+    for (int i = 0; i< LCOUNT(syms); i++) {
+        /* A name bound once more is no longer folded, see fold.c */
+        lenv* target = e;
+        while (strcmp(func, "def") == 0 && target->par) { target = target->par; }
+        if (lenv_find(target, LSYM(LCELL(syms)[i])) >= 0) {
+            lenv_rebound(LCELL(syms)[i]);
+        }
 
-    for (int i = 0; i< syms->count; i++) {
         if (strcmp(func, "def") == 0) {
-            lenv_def(e, syms->cell[i], a->cell[i+1]);
+            lenv_def(e, LCELL(syms)[i], LCELL(a)[i+1]);
         }
         if (strcmp(func, "=") == 0) {
-            lenv_put(e, syms->cell[i], a->cell[i+1]);
+            lenv_put(e, LCELL(syms)[i], LCELL(a)[i+1]);
         }
     }
 
@@ -292,207 +1065,195 @@ lval* builtin_env(lenv* e, lval* a)
     for (int i = 0; i < e->count; i++) {
         printf("%s\n", e->syms[i]);
     }
-    return lval_pop(a, 0);
+    return lval_take(a, 0);
 }
 
 lval* builtin_inc(lenv* e, lval* a)
 {
-    LASSERT_NUM("++", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
-        lval_del(a);
-        return lval_err("Cannot operate on %s. %s or %s expected",
-                ltype_name(a->cell[0]->type),
-                ltype_name(LVAL_NUM),
-                ltype_name(LVAL_DEC));
-    }
-
-    lval* x = lval_pop(a, 0);
-
-    if (x->type == LVAL_NUM) {
-        int n = x->num + 1;
-        lval_del(x);
-        return lval_num(n);
-    } else {
-        double n = x->decimal + 1;
-        lval_del(x);
-        return lval_dec(n);
-    }
+    lval* r = builtin_inc_v(e, LCOUNT(a), LCELL(a));
+    lval_del(a);
+    return r;
 }
 
 lval* builtin_dec(lenv* e, lval* a)
 {
-    LASSERT_NUM("--", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
-        lval_del(a);
+    lval* r = builtin_dec_v(e, LCOUNT(a), LCELL(a));
+    lval_del(a);
+    return r;
+}
+
+static lval* builtin_step(int argc, lval** argv, char* op, int step)
+{
+    if (argc != 1) {
+        return lval_err("Function '%s' passed incorrect number for arguments. Got %i, expected %i.",
+                op, argc, 1);
+    }
+    if (LTYPE(argv[0]) != LVAL_NUM && LTYPE(argv[0]) != LVAL_DEC) {
         return lval_err("Cannot operate on %s. %s or %s expected",
-                ltype_name(a->cell[0]->type),
+                ltype_name(LTYPE(argv[0])),
                 ltype_name(LVAL_NUM),
                 ltype_name(LVAL_DEC));
     }
 
-    lval* x = lval_pop(a, 0);
-
-    if (x->type == LVAL_NUM) {
-        int n = x->num - 1;
-        lval_del(x);
+    if (LTYPE(argv[0]) == LVAL_NUM) {
+        int n = LNUM(argv[0]) + step;
         return lval_num(n);
     } else {
-        double n = x->decimal - 1;
-        lval_del(x);
-        return lval_dec(n);
+        return lval_dec(LDEC(argv[0]) + step);
     }
-
-}
-
-/**
- * Arithmetic
- */
-lval* builtin_add(lenv* e, lval* a)
-{
-    return builtin_op(e, a, "+");
 }
 
-lval* builtin_sub(lenv* e, lval* a)
+lval* builtin_inc_v(lenv* e, int argc, lval** argv)
 {
-    return builtin_op(e, a, "-");
+    return builtin_step(argc, argv, "++", 1);
 }
 
-lval* builtin_mul(lenv* e, lval* a)
+lval* builtin_dec_v(lenv* e, int argc, lval** argv)
 {
-    return builtin_op(e, a, "*");
+    return builtin_step(argc, argv, "--", -1);
 }
 
-lval* builtin_div(lenv* e, lval* a)
+/**
+ * Arithmetic
+ */
+lval* builtin_op(lenv* e, lval* a, int op)
 {
-    return builtin_op(e, a, "/");
+    lval* r = builtin_op_v(e, LCOUNT(a), LCELL(a), op);
+    lval_del(a);
+    return r;
 }
 
-lval* builtin_mod(lenv* e, lval* a)
+/**
+ * Kernels folding the n values of argv into *acc, integer and decimal.
+ * They return an error message, or NULL.
+ */
+static char* arith_num(int op, long* acc, lval** argv, int n)
 {
-    return builtin_op(e, a, "%");
-}
+    long x = *acc;
+
+    switch (op) {
+        case ARITH_ADD:
+            for (int i = 0; i < n; i++) { x += LNUM(argv[i]); }
+            break;
+        case ARITH_SUB:
+            for (int i = 0; i < n; i++) { x -= LNUM(argv[i]); }
+            break;
+        case ARITH_MUL:
+            for (int i = 0; i < n; i++) { x *= LNUM(argv[i]); }
+            break;
+        case ARITH_DIV:
+            for (int i = 0; i < n; i++) {
+                if (LNUM(argv[i]) == 0) { return "Division by zero!"; }
+                x /= LNUM(argv[i]);
+            }
+            break;
+        case ARITH_MOD:
+            for (int i = 0; i < n; i++) {
+                if (LNUM(argv[i]) == 0) { return "Modulus by zero!"; }
+                x %= LNUM(argv[i]);
+            }
+            break;
+        case ARITH_POW:
+            for (int i = 0; i < n; i++) { x = pow(x, LNUM(argv[i])); }
+            break;
+        case ARITH_MIN:
+            for (int i = 0; i < n; i++) { x = min(x, LNUM(argv[i])); }
+            break;
+        case ARITH_MAX:
+            for (int i = 0; i < n; i++) { x = max(x, LNUM(argv[i])); }
+            break;
+    }
 
-lval* builtin_pow(lenv* e, lval* a)
-{
-    return builtin_op(e, a, "^");
+    *acc = x;
+    return NULL;
 }
 
-lval* builtin_min(lenv* e, lval* a)
+static char* arith_dec(int op, double* acc, lval** argv, int n)
 {
-    return builtin_op(e, a, "min");
-}
+    double x = *acc;
+
+    for (int i = 0; i < n; i++) {
+        double y = LTYPE(argv[i]) == LVAL_DEC ? LDEC(argv[i]) : LNUM(argv[i]);
+
+        switch (op) {
+            case ARITH_ADD: x += y; break;
+            case ARITH_SUB: x -= y; break;
+            case ARITH_MUL: x *= y; break;
+            case ARITH_DIV:
+                if (y == 0) { return "Division by zero!"; }
+                x /= y;
+                break;
+            case ARITH_MOD:
+                if (y == 0) { return "Modulus by zero!"; }
+                x = fmod(x, y);
+                break;
+            case ARITH_POW: x = pow(x, y); break;
+            case ARITH_MIN: x = fmin(x, y); break;
+            case ARITH_MAX: x = fmax(x, y); break;
+        }
+    }
 
-lval* builtin_max(lenv* e, lval* a)
-{
-    return builtin_op(e, a, "max");
+    *acc = x;
+    return NULL;
 }
-lval* builtin_inc(lenv* e, lval* a);
 
-lval* builtin_op(lenv* e, lval* a, char* op)
+lval* builtin_op_v(lenv* e, int argc, lval** argv, int op)
 {
-    /* Ensure all arguments are numbers */
-    for (int i = 0; i < a->count; i++) {
-        if (a->cell[i]->type != LVAL_NUM && a->cell[i]->type != LVAL_DEC) {
-            lval_del(a);
+    /* Ensure all arguments are numbers, and find the first decimal */
+    int k = argc;
+    for (int i = 0; i < argc; i++) {
+        if (LTYPE(argv[i]) != LVAL_NUM && LTYPE(argv[i]) != LVAL_DEC) {
             return lval_err("Cannot operate on %s. %s or %s expected",
-                    ltype_name(a->cell[i]->type),
+                    ltype_name(LTYPE(argv[i])),
                     ltype_name(LVAL_NUM),
                     ltype_name(LVAL_DEC));
         }
+        if (LTYPE(argv[i]) == LVAL_DEC && k == argc) { k = i; }
     }
 
-    /* Pop the first element */
-    lval* x = lval_pop(a, 0);
-
-    if ((strcmp(op, "-") == 0) && (a->count == 0)) { 
-        if (x->type == LVAL_NUM) x->num = -x->num;
-        if (x->type == LVAL_DEC) x->decimal = -x->decimal;
+    /**
+     * Integers are folded up to the first decimal, the rest as decimals.
+     * Work on plain numbers and only build the result at the end, so
+     * results that fit in a tagged pointer never touch the pool.
+     */
+    int is_dec = k < argc;
+    long xn = 0;
+    double xd;
+    char* err = NULL;
+
+    if (k > 0) {
+        xn = LNUM(argv[0]);
+        if (op == ARITH_SUB && argc == 1) { xn = -xn; }
+        err = arith_num(op, &xn, argv + 1, k - 1);
+        xd = xn;
+    } else {
+        xd = LDEC(argv[0]);
+        if (op == ARITH_SUB && argc == 1) { xd = -xd; }
+        k = 1;
     }
 
-    while (a->count > 0) {
-        lval* y = lval_pop(a, 0);
-
-        if (x->type == LVAL_NUM && y->type == LVAL_NUM) {
-            /* Operations */
-            if (strcmp(op, "+") == 0) { x->num += y->num; }
-            if (strcmp(op, "-") == 0) { x->num -= y->num; }
-            if (strcmp(op, "*") == 0) { x->num *= y->num; }
-            if (strcmp(op, "^") == 0) { x->num = pow(x->num, y->num); }
-            if (strcmp(op, "min") == 0) { x->num = min(x->num, y->num); }
-            if (strcmp(op, "max") == 0) { x->num = max(x->num, y->num); }
-            if (strcmp(op, "%") == 0) {
-                if (y->num == 0) {
-                    lval_del(x); lval_del(y);
-                    x = lval_err("Modulus by zero!");
-                    break;
-                }
-                x->num = x->num % y->num;
-            }
-            if (strcmp(op, "/") == 0) {
-                if (y->num == 0) {
-                    lval_del(x); lval_del(y);
-                    x = lval_err("Division by zero!");
-                    break;
-                }
-                x->num /= y->num;
-            }
-        } else {
-            /* One of the operands is a notnum */
-            if (x->type == LVAL_DEC && y->type == LVAL_NUM) {
-                y->type = LVAL_DEC;
-                y->decimal = (double)(y->num);
-            } else if (x->type == LVAL_NUM && y->type == LVAL_DEC) {
-                x->type = LVAL_DEC;
-                x->decimal = (double)(x->num);
-            }
-            /* Operations */
-            if (strcmp(op, "+") == 0) { x->decimal += y->decimal; }
-            if (strcmp(op, "-") == 0) { x->decimal -= y->decimal; }
-            if (strcmp(op, "*") == 0) { x->decimal *= y->decimal; }
-            if (strcmp(op, "^") == 0) { x->decimal = pow(x->decimal, y->decimal); }
-            if (strcmp(op, "min") == 0) { x->decimal = fmin(x->decimal, y->decimal); }
-            if (strcmp(op, "max") == 0) { x->decimal = fmax(x->decimal, y->decimal); }
-            if (strcmp(op, "%") == 0) {
-                if (y->decimal == 0) {
-                    lval_del(x); lval_del(y);
-                    x = lval_err("Modulus by zero!");
-                    break;
-                }
-                x->decimal = fmod(x->decimal, y->decimal);
-            }
-            if (strcmp(op, "/") == 0) {
-                if (y->decimal == 0) {
-                    lval_del(x); lval_del(y);
-                    x = lval_err("Division by zero!");
-                    break;
-                }
-                x->decimal /= y->decimal;
-            }
-        }
-
-        /* Delete y element */
-        lval_del(y);
+    if (err == NULL && k < argc) {
+        err = arith_dec(op, &xd, argv + k, argc - k);
     }
 
-    /* Delete input expression and return result */
-    lval_del(a);
-    return x;
+    if (err) { return lval_err("%s", err); }
+    return is_dec ? lval_dec(xd) : lval_num(xn);
 }
 
 lval* builtin_ln(lenv* e, lval* a)
 {
     LASSERT_NUM("ln", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     double r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = log(a->cell[0]->num);
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = log(LNUM(LCELL(a)[0]));
     } else {
-        r = log(a->cell[0]->decimal);
+        r = log(LDEC(LCELL(a)[0]));
     }
 
     lval_del(a);
@@ -502,17 +1263,17 @@ lval* builtin_ln(lenv* e, lval* a)
 lval* builtin_log(lenv* e, lval* a)
 {
     LASSERT_NUM("log", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     double r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = log10(a->cell[0]->num);
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = log10(LNUM(LCELL(a)[0]));
     } else {
-        r = log10(a->cell[0]->decimal);
+        r = log10(LDEC(LCELL(a)[0]));
     }
 
     lval_del(a);
@@ -522,17 +1283,17 @@ lval* builtin_log(lenv* e, lval* a)
 lval* builtin_ceil(lenv* e, lval* a)
 {
     LASSERT_NUM("ln", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     int r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = a->cell[0]->num;
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = LNUM(LCELL(a)[0]);
     } else {
-        r = ceil(a->cell[0]->decimal);
+        r = ceil(LDEC(LCELL(a)[0]));
     }
     lval_del(a);
     return lval_num(r);
@@ -541,17 +1302,17 @@ lval* builtin_ceil(lenv* e, lval* a)
 lval* builtin_floor(lenv* e, lval* a)
 {
     LASSERT_NUM("ln", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     int r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = a->cell[0]->num;
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = LNUM(LCELL(a)[0]);
     } else {
-        r = floor(a->cell[0]->decimal);
+        r = floor(LDEC(LCELL(a)[0]));
     }
     lval_del(a);
     return lval_num(r);
@@ -565,10 +1326,10 @@ lval* builtin_rand(lenv* e, lval* a)
     double r;
     srand(time(NULL));
 
-    if (a->cell[0]->num < 1) {
+    if (LNUM(LCELL(a)[0]) < 1) {
         r = 1;
     } else {
-        r = rand() % a->cell[0]->num + (float)(rand() % 1000000) / 1000000;
+        r = rand() % LNUM(LCELL(a)[0]) + (float)(rand() % 1000000) / 1000000;
     }
 
     lval_del(a);
@@ -581,17 +1342,17 @@ lval* builtin_rand(lenv* e, lval* a)
 lval* builtin_sin(lenv* e, lval* a)
 {
     LASSERT_NUM("sin", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     double r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = a->cell[0]->num;
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = LNUM(LCELL(a)[0]);
     } else {
-        r = ceil(a->cell[0]->decimal);
+        r = ceil(LDEC(LCELL(a)[0]));
     }
     lval_del(a);
     return lval_dec(sin(r));
@@ -600,17 +1361,17 @@ lval* builtin_sin(lenv* e, lval* a)
 lval* builtin_sinh(lenv* e, lval* a)
 {
     LASSERT_NUM("sinh", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     double r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = a->cell[0]->num;
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = LNUM(LCELL(a)[0]);
     } else {
-        r = ceil(a->cell[0]->decimal);
+        r = ceil(LDEC(LCELL(a)[0]));
     }
     lval_del(a);
     return lval_dec(sinh(r));
@@ -619,17 +1380,17 @@ lval* builtin_sinh(lenv* e, lval* a)
 lval* builtin_cos(lenv* e, lval* a)
 {
     LASSERT_NUM("cos", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     double r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = a->cell[0]->num;
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = LNUM(LCELL(a)[0]);
     } else {
-        r = ceil(a->cell[0]->decimal);
+        r = ceil(LDEC(LCELL(a)[0]));
     }
     lval_del(a);
     return lval_dec(cos(r));
@@ -638,17 +1399,17 @@ lval* builtin_cos(lenv* e, lval* a)
 lval* builtin_cosh(lenv* e, lval* a)
 {
     LASSERT_NUM("cosh", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     double r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = a->cell[0]->num;
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = LNUM(LCELL(a)[0]);
     } else {
-        r = ceil(a->cell[0]->decimal);
+        r = ceil(LDEC(LCELL(a)[0]));
     }
     lval_del(a);
     return lval_dec(cosh(r));
@@ -657,17 +1418,17 @@ lval* builtin_cosh(lenv* e, lval* a)
 lval* builtin_tan(lenv* e, lval* a)
 {
     LASSERT_NUM("tan", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     double r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = a->cell[0]->num;
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = LNUM(LCELL(a)[0]);
     } else {
-        r = ceil(a->cell[0]->decimal);
+        r = ceil(LDEC(LCELL(a)[0]));
     }
     lval_del(a);
     return lval_dec(tan(r));
@@ -676,17 +1437,17 @@ lval* builtin_tan(lenv* e, lval* a)
 lval* builtin_tanh(lenv* e, lval* a)
 {
     LASSERT_NUM("tanh", a, 1);
-    if (a->cell[0]->type != LVAL_NUM && a->cell[0]->type != LVAL_DEC) {
+    if (LTYPE(LCELL(a)[0]) != LVAL_NUM && LTYPE(LCELL(a)[0]) != LVAL_DEC) {
         lval_del(a);
         return lval_err("Cannot operate on non-number. %s or %s expected",
                 ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
     }
 
     double r;
-    if (a->cell[0]->type == LVAL_NUM) {
-        r = a->cell[0]->num;
+    if (LTYPE(LCELL(a)[0]) == LVAL_NUM) {
+        r = LNUM(LCELL(a)[0]);
     } else {
-        r = ceil(a->cell[0]->decimal);
+        r = ceil(LDEC(LCELL(a)[0]));
     }
     lval_del(a);
     return lval_dec(tanh(r));
@@ -705,9 +1466,10 @@ lval* builtin_leftshift(lenv* e, lval* a)
     lval* x = lval_pop(a, 0);
     lval* y = lval_pop(a, 0);
 
-    r = x->num << y->num;
+    r = LNUM(x) << LNUM(y);
     lval_del(x);
     lval_del(y);
+    lval_del(a);
     return lval_num(r);
 }
 
@@ -721,9 +1483,10 @@ lval* builtin_rightshift(lenv* e, lval* a)
     lval* x = lval_pop(a, 0);
     lval* y = lval_pop(a, 0);
 
-    r = x->num >> y->num;
+    r = LNUM(x) >> LNUM(y);
     lval_del(x);
     lval_del(y);
+    lval_del(a);
     return lval_num(r);
 }
 
@@ -737,9 +1500,10 @@ lval* builtin_bitwiseand(lenv* e, lval* a)
     lval* x = lval_pop(a, 0);
     lval* y = lval_pop(a, 0);
 
-    r = x->num & y->num;
+    r = LNUM(x) & LNUM(y);
     lval_del(x);
     lval_del(y);
+    lval_del(a);
     return lval_num(r);
 }
 
@@ -753,9 +1517,10 @@ lval* builtin_bitwiseor(lenv* e, lval* a)
     lval* x = lval_pop(a, 0);
     lval* y = lval_pop(a, 0);
 
-    r = x->num | y->num;
+    r = LNUM(x) | LNUM(y);
     lval_del(x);
     lval_del(y);
+    lval_del(a);
     return lval_num(r);
 }
 
@@ -769,109 +1534,133 @@ lval* builtin_bitwisexor(lenv* e, lval* a)
     lval* x = lval_pop(a, 0);
     lval* y = lval_pop(a, 0);
 
-    r = x->num ^ y->num;
+    r = LNUM(x) ^ LNUM(y);
     lval_del(x);
     lval_del(y);
+    lval_del(a);
     return lval_num(r);
 }
 
-lval* builtin_gt(lenv* e, lval* a)
+lval* builtin_ord(lenv* e, lval* a, int op)
 {
-    return builtin_ord(e, a, ">");
-}
-
-lval* builtin_lt(lenv* e, lval* a)
-{
-    return builtin_ord(e, a, "<");
+    lval* r = builtin_ord_v(e, LCOUNT(a), LCELL(a), op);
+    lval_del(a);
+    return r;
 }
 
-lval* builtin_ge(lenv* e, lval* a)
+static int ord_num(int op, long x, long y)
 {
-    return builtin_ord(e, a, "<=");
+    switch (op) {
+        case ORD_GT: return x > y;
+        case ORD_LT: return x < y;
+        case ORD_GE: return x >= y;
+        default: return x <= y;
+    }
 }
 
-lval* builtin_le(lenv* e, lval* a)
+static int ord_dec(int op, double x, double y)
 {
-    return builtin_ord(e, a, ">=");
+    switch (op) {
+        case ORD_GT: return x > y;
+        case ORD_LT: return x < y;
+        case ORD_GE: return x >= y;
+        default: return x <= y;
+    }
 }
 
-lval* builtin_ord(lenv* e, lval* a, char* op)
+lval* builtin_ord_v(lenv* e, int argc, lval** argv, int op)
 {
-    LASSERT_NUM(op, a, 2);
+    if (argc != 2) {
+        return lval_err("Function '%s' passed incorrect number for arguments. Got %i, expected %i.",
+                op_names[op], argc, 2);
+    }
     /* Ensure all arguments are numbers */
-    for (int i = 0; i < a->count; i++) {
-        if (a->cell[i]->type != LVAL_NUM && a->cell[i]->type != LVAL_DEC) {
-            lval_del(a);
+    for (int i = 0; i < argc; i++) {
+        if (LTYPE(argv[i]) != LVAL_NUM && LTYPE(argv[i]) != LVAL_DEC) {
             return lval_err("Cannot operate on non-number. %s or %s expected",
                     ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
         }
     }
 
-    int r;
-    lval* x = lval_pop(a, 0);
-    lval* y = lval_pop(a, 0);
-
-    if (x->type == LVAL_NUM && y->type == LVAL_NUM) {
-        if (strcmp(op, ">") == 0) {
-            r = (x->num > y->num);
-        }
-        if (strcmp(op, "<") == 0) {
-            r = (x->num < y->num);
-        }
-        if (strcmp(op, ">=") == 0) {
-            r = (x->num >= y->num);
-        }
-        if (strcmp(op, "<=") == 0) {
-            r = (x->num <= y->num);
-        }
-    } else {
-        /* One of the operands is a notnum */
-        if (x->type == LVAL_DEC && y->type == LVAL_NUM) {
-            y->type = LVAL_DEC;
-            y->decimal = (double)(y->num);
-        } else if (x->type == LVAL_NUM && y->type == LVAL_DEC) {
-            x->type = LVAL_DEC;
-            x->decimal = (double)(x->num);
-        }
-        if (strcmp(op, ">") == 0) {
-            r = (x->decimal > y->decimal);
-        }
-        if (strcmp(op, "<") == 0) {
-            r = (x->decimal < y->decimal);
-        }
-        if (strcmp(op, ">=") == 0) {
-            r = (x->decimal >= y->decimal);
-        }
-        if (strcmp(op, "<=") == 0) {
-            r = (x->decimal <= y->decimal);
-        }
+    lval* x = argv[0];
+    lval* y = argv[1];
+    if (LTYPE(x) == LVAL_NUM && LTYPE(y) == LVAL_NUM) {
+        return lval_bool(ord_num(op, LNUM(x), LNUM(y)));
     }
 
-    lval_del(a);
-    return lval_bool(r);
+    /* One of the operands is a notnum */
+    double xd = LTYPE(x) == LVAL_DEC ? LDEC(x) : LNUM(x);
+    double yd = LTYPE(y) == LVAL_DEC ? LDEC(y) : LNUM(y);
+    return lval_bool(ord_dec(op, xd, yd));
 }
 
+/**
+ * The operator builtins with the kernel and operator behind each, their
+ * list and argument array taking entries are generated from this. The
+ * builtins bound to >= and <= compare the other way around.
+ */
+#define BUILTIN_OPS(X) \
+    X(add, op, ARITH_ADD) \
+    X(sub, op, ARITH_SUB) \
+    X(mul, op, ARITH_MUL) \
+    X(div, op, ARITH_DIV) \
+    X(mod, op, ARITH_MOD) \
+    X(pow, op, ARITH_POW) \
+    X(min, op, ARITH_MIN) \
+    X(max, op, ARITH_MAX) \
+    X(gt, ord, ORD_GT) \
+    X(lt, ord, ORD_LT) \
+    X(ge, ord, ORD_LE) \
+    X(le, ord, ORD_GE) \
+    X(eq, cmp, CMP_EQ) \
+    X(ne, cmp, CMP_NE)
+
+#define BUILTIN_OP(name, kernel, op) \
+    lval* builtin_##name(lenv* e, lval* a) \
+    { \
+        return builtin_##kernel(e, a, op); \
+    } \
+    \
+    lval* builtin_##name##_v(lenv* e, int argc, lval** argv) \
+    { \
+        return builtin_##kernel##_v(e, argc, argv, op); \
+    }
+
+BUILTIN_OPS(BUILTIN_OP)
+
 lval* builtin_load(lenv* e, lval* a)
 {
     LASSERT_NUM("load", a, 1);
     LASSERT_TYPE("load", a, 0, LVAL_STR);
 
+    char path[512];
+
     mpc_result_t r;
-    if (!strstr(a->cell[0]->str, ".lspy")) {
-        strcat(a->cell[0]->str, ".lspy");
-    }
-    if (mpc_parse_contents(a->cell[0]->str, Lispy, &r)) {
+    snprintf(path, sizeof(path), "%s%s", LSTR(LCELL(a)[0]),
+            strstr(LSTR(LCELL(a)[0]), ".lspy") ? "" : ".lspy");
+
+    if (mpc_parse_contents(path, Lispy, &r)) {
         /* Read contents */
         lval* expr = lval_read(r.output);
         mpc_ast_delete(r.output);
 
-        while (expr->count) {
-            lval* x = lval_eval(e, lval_pop(expr, 0));
-            if (x->type == LVAL_ERR) {
+        /* Folding may be turned on halfway through, scan the file regardless */
+        fold_scan(expr);
+
+        gc_push(a);
+        gc_push(expr);
+        while (LCOUNT(expr)) {
+            /* Temporaries of each top-level form live in their own region */
+            lval* x = fold_form(e, lval_pop(expr, 0));
+            lval_region_begin(e);
+            x = lval_eval(e, x);
+            if (LTYPE(x) == LVAL_ERR) {
                 lval_println(x);
             }
             lval_del(x);
+            lval_region_end();
         }
+        gc_pop(2);
 
         lval_del(expr);
         lval_del(a);
@@ -897,24 +1686,31 @@ lval* builtin_include(lenv* e, lval* a)
     char stdlib_path[512];
 
     mpc_result_t r;
-    if (!strstr(a->cell[0]->str, ".lspy")) {
-        strcat(a->cell[0]->str, ".lspy");
-    }
-
-    sprintf(stdlib_path, "%s/%s", GLIB_PFIX, a->cell[0]->str);
+    snprintf(stdlib_path, sizeof(stdlib_path), "%s/%s%s", GLIB_PFIX, LSTR(LCELL(a)[0]),
+            strstr(LSTR(LCELL(a)[0]), ".lspy") ? "" : ".lspy");
 
     if (mpc_parse_contents(stdlib_path, Lispy, &r)) {
         /* Read contents */
         lval* expr = lval_read(r.output);
         mpc_ast_delete(r.output);
 
-        while (expr->count) {
-            lval* x = lval_eval(e, lval_pop(expr, 0));
-            if (x->type == LVAL_ERR) {
+        /* Folding may be turned on halfway through, scan the file regardless */
+        fold_scan(expr);
+
+        gc_push(a);
+        gc_push(expr);
+        while (LCOUNT(expr)) {
+            /* Temporaries of each top-level form live in their own region */
+            lval* x = fold_form(e, lval_pop(expr, 0));
+            lval_region_begin(e);
+            x = lval_eval(e, x);
+            if (LTYPE(x) == LVAL_ERR) {
                 lval_println(x);
             }
             lval_del(x);
+            lval_region_end();
         }
+        gc_pop(2);
 
         lval_del(expr);
         lval_del(a);
@@ -934,8 +1730,8 @@ lval* builtin_include(lenv* e, lval* a)
 
 lval* builtin_print(lenv* e, lval* a)
 {
-    for (int i = 0; i < a->count; i++) {
-        lval_print(a->cell[i]);
+    for (int i = 0; i < LCOUNT(a); i++) {
+        lval_print(LCELL(a)[i]);
         putchar(' ');
     }
     putchar('\n');
@@ -955,7 +1751,25 @@ lval* builtin_version(lenv* e, lval* a)
 {
     printf("Version: %s, build: %s (%s)\n", version, VERSION_BUILD, BUILD_DATE);
 
-    return lval_pop(a, 0);
+    return lval_take(a, 0);
+}
+
+lval* builtin_mem(lenv* e, lval* a)
+{
+    pool_print_stats(&lval_pool);
+    pool_print_stats(&lenv_pool);
+    gc_print_stats();
+
+    lval_del(a);
+    return lval_sexpr();
+}
+
+lval* builtin_gc(lenv* e, lval* a)
+{
+    long freed = gc_collect();
+
+    lval_del(a);
+    return lval_num(freed);
 }
 
 lval* builtin_set(lenv* e, lval* a)
@@ -969,16 +1783,29 @@ lval* builtin_set(lenv* e, lval* a)
 
     lval_del(a);
 
-    if (strcmp(key->str, "dec") == 0) {
-        set_decimal(val->num);
-        return lval_sexpr();
-    } else if (strcmp(key->str, "splash") == 0) {
-        set_splash(val->num);
-        return lval_sexpr();
+    lval* r;
+    if (strcmp(LSTR(key), "dec") == 0) {
+        set_decimal(LNUM(val));
+        r = lval_sexpr();
+    } else if (strcmp(LSTR(key), "splash") == 0) {
+        set_splash(LNUM(val));
+        r = lval_sexpr();
+    } else if (strcmp(LSTR(key), "depth") == 0) {
+        set_depth(LNUM(val));
+        r = lval_sexpr();
+    } else if (strcmp(LSTR(key), "vm") == 0) {
+        set_vm(LNUM(val));
+        r = lval_sexpr();
+    } else if (strcmp(LSTR(key), "fold") == 0) {
+        set_fold(LNUM(val));
+        r = lval_sexpr();
     } else {
-        lval* err = lval_err("Unknown setting-key '%s'", key->str);
-        return err;
+        r = lval_err("Unknown setting-key '%s'", LSTR(key));
     }
+
+    lval_del(key);
+    lval_del(val);
+    return r;
 }
 
 lval* builtin_get(lenv* e, lval* a)
@@ -988,16 +1815,32 @@ lval* builtin_get(lenv* e, lval* a)
 
     lval* val = lval_pop(a, 0);
 
-    if (strcmp(val->str, "dec") == 0) {
+    if (strcmp(LSTR(val), "dec") == 0) {
         int dec = get_decimal();
 
-        val->type = LVAL_NUM;
-        val->num = dec;
+        lval_del(val);
+        lval_del(a);
+        return lval_num(dec);
+    } else if (strcmp(LSTR(val), "depth") == 0) {
+        int depth = get_depth();
+
+        lval_del(val);
+        lval_del(a);
+        return lval_num(depth);
+    } else if (strcmp(LSTR(val), "vm") == 0) {
+        int vm = get_vm();
+
+        lval_del(val);
+        lval_del(a);
+        return lval_num(vm);
+    } else if (strcmp(LSTR(val), "fold") == 0) {
+        int fold = get_fold();
 
+        lval_del(val);
         lval_del(a);
-        return val;
+        return lval_num(fold);
     } else {
-        lval* err = lval_err("Unknown setting-key '%s'", val->str);
+        lval* err = lval_err("Unknown setting-key '%s'", LSTR(val));
         lval_del(a);
         return err;
     }
@@ -1009,7 +1852,7 @@ lval* builtin_error(lenv* e, lval* a)
     LASSERT_NUM("error", a, 1);
     LASSERT_TYPE("error", a, 0, LVAL_STR);
 
-    lval* err = lval_err(a->cell[0]->str);
+    lval* err = lval_err(LSTR(LCELL(a)[0]));
 
     lval_del(a);
 
@@ -1017,10 +1860,27 @@ lval* builtin_error(lenv* e, lval* a)
 }
 
 void lenv_add_builtin(lenv* e, char* name, lbuiltin func)
+{
+    lenv_add_builtin_v(e, name, func, NULL);
+}
+
+void lenv_add_builtin_v(lenv* e, char* name, lbuiltin func, lbuiltinv vfunc)
+{
+    lval* k = lval_sym(name);
+    lval* v = lval_fun(func);
+    LBUILTINV(v) = vfunc;
+    v->is_builtin = 1;
+    lenv_put(e, k ,v);
+    lval_del(k);
+    lval_del(v);
+}
+
+void lenv_add_builtin_s(lenv* e, char* name, lbuiltin func)
 {
     lval* k = lval_sym(name);
     lval* v = lval_fun(func);
     v->is_builtin = 1;
+    v->special = 1;
     lenv_put(e, k ,v);
     lval_del(k);
     lval_del(v);
@@ -1029,7 +1889,7 @@ void lenv_add_builtin(lenv* e, char* name, lbuiltin func)
 void lenv_add_builtin_var(lenv* e, char* name, lval* val)
 {
     lval* k = lval_sym(name);
-    lval* v = lval_copy(val);
+    lval* v = val;
     v->is_builtin = 1;
     lenv_put(e, k, v);
     lval_del(k);
@@ -1065,21 +1925,31 @@ void lenv_add_builtins(lenv* e)
     lenv_add_builtin(e, "join", builtin_join);
     lenv_add_builtin(e, "init", builtin_init);
 
+    /* Vector operations */
+    lenv_add_builtin(e, "vec", builtin_vec);
+    lenv_add_builtin(e, "unvec", builtin_unvec);
+    lenv_add_builtin(e, "len", builtin_len);
+    lenv_add_builtin(e, "nth", builtin_nth);
+    lenv_add_builtin(e, "assoc", builtin_assoc);
+    lenv_add_builtin(e, "push", builtin_push);
+    lenv_add_builtin(e, "slice", builtin_slice);
+    lenv_add_builtin(e, "concat", builtin_concat);
+
     /* Arithmetic */
-    lenv_add_builtin(e, "+", builtin_add);
-    lenv_add_builtin(e, "-", builtin_sub);
-    lenv_add_builtin(e, "*", builtin_mul);
-    lenv_add_builtin(e, "/", builtin_div);
-    lenv_add_builtin(e, "%", builtin_mod);
-    lenv_add_builtin(e, "++", builtin_inc);
-    lenv_add_builtin(e, "--", builtin_dec);
-    lenv_add_builtin(e, "pow", builtin_pow);
+    lenv_add_builtin_v(e, "+", builtin_add, builtin_add_v);
+    lenv_add_builtin_v(e, "-", builtin_sub, builtin_sub_v);
+    lenv_add_builtin_v(e, "*", builtin_mul, builtin_mul_v);
+    lenv_add_builtin_v(e, "/", builtin_div, builtin_div_v);
+    lenv_add_builtin_v(e, "%", builtin_mod, builtin_mod_v);
+    lenv_add_builtin_v(e, "++", builtin_inc, builtin_inc_v);
+    lenv_add_builtin_v(e, "--", builtin_dec, builtin_dec_v);
+    lenv_add_builtin_v(e, "pow", builtin_pow, builtin_pow_v);
     lenv_add_builtin(e, "ln", builtin_ln);
     lenv_add_builtin(e, "log", builtin_log);
     lenv_add_builtin(e, "ceil", builtin_ceil);
     lenv_add_builtin(e, "floor", builtin_floor);
-    lenv_add_builtin(e, "min", builtin_min);
-    lenv_add_builtin(e, "max", builtin_max);
+    lenv_add_builtin_v(e, "min", builtin_min, builtin_min_v);
+    lenv_add_builtin_v(e, "max", builtin_max, builtin_max_v);
     lenv_add_builtin(e, "rand", builtin_rand);
 
     /* Trigonometry */
@@ -1098,22 +1968,36 @@ void lenv_add_builtins(lenv* e)
     lenv_add_builtin(e, "^", builtin_bitwisexor);
 
     /* Conditionals */
-    lenv_add_builtin(e, "if", builtin_if);
-    lenv_add_builtin(e, "==", builtin_eq);
-    lenv_add_builtin(e, "!=", builtin_ne);
-    lenv_add_builtin(e, ">", builtin_gt);
-    lenv_add_builtin(e, "<", builtin_lt);
-    lenv_add_builtin(e, ">=", builtin_ge);
-    lenv_add_builtin(e, "<=", builtin_le);
-    lenv_add_builtin(e, "&&", builtin_and);
-    lenv_add_builtin(e, "||", builtin_or);
+    lenv_add_builtin_s(e, "if", builtin_if);
+    lenv_add_builtin_s(e, "when", builtin_when);
+    lenv_add_builtin_s(e, "cond", builtin_cond);
+    lenv_add_builtin_v(e, "==", builtin_eq, builtin_eq_v);
+    lenv_add_builtin_v(e, "!=", builtin_ne, builtin_ne_v);
+    lenv_add_builtin_v(e, ">", builtin_gt, builtin_gt_v);
+    lenv_add_builtin_v(e, "<", builtin_lt, builtin_lt_v);
+    lenv_add_builtin_v(e, ">=", builtin_ge, builtin_ge_v);
+    lenv_add_builtin_v(e, "<=", builtin_le, builtin_le_v);
+    lenv_add_builtin_s(e, "&&", builtin_and);
+    lenv_add_builtin_s(e, "||", builtin_or);
+    lenv_add_builtin_s(e, "and", builtin_and_word);
+    lenv_add_builtin_s(e, "or", builtin_or_word);
     lenv_add_builtin(e, "!", builtin_not);
     lenv_add_builtin(e, "xor", builtin_xor);
 
+    /* Loops */
+    lenv_add_builtin_s(e, "while", builtin_while);
+    lenv_add_builtin_s(e, "dotimes", builtin_dotimes);
+    lenv_add_builtin_s(e, "doseq", builtin_doseq);
+    lenv_add_builtin_s(e, "loop", builtin_loop);
+    lenv_add_builtin(e, "recur", builtin_recur);
+    lenv_add_builtin_s(e, "let", builtin_let);
+
     /* Other functions */
     lenv_add_builtin(e, "exit", builtin_exit);
     lenv_add_builtin(e, "quit", builtin_exit);
     lenv_add_builtin(e, "set", builtin_set);
     lenv_add_builtin(e, "get", builtin_get);
     lenv_add_builtin(e, "version", builtin_version);
+    lenv_add_builtin(e, "mem", builtin_mem);
+    lenv_add_builtin(e, "gc", builtin_gc);
 }
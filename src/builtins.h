@@ -41,7 +41,13 @@
 #include "lval.h"
 #include "mpc.h"
 
+/* Operators of the arithmetic, ordering and equality builtins */
+enum { ARITH_ADD, ARITH_SUB, ARITH_MUL, ARITH_DIV, ARITH_MOD, ARITH_POW,
+    ARITH_MIN, ARITH_MAX, ORD_GT, ORD_LT, ORD_GE, ORD_LE, CMP_EQ, CMP_NE };
+
 void lenv_add_builtin(lenv* e, char* name, lbuiltin func);
+void lenv_add_builtin_v(lenv* e, char* name, lbuiltin func, lbuiltinv vfunc);
+void lenv_add_builtin_s(lenv* e, char* name, lbuiltin func);
 void lenv_add_builtin_var(lenv* e, char* name, lval* val);
 void lenv_add_builtins(lenv* e);
 
@@ -68,8 +74,18 @@ lval* builtin_cons(lenv* e, lval* a);
 lval* builtin_join(lenv* e, lval* a);
 lval* builtin_init(lenv* e, lval* a);
 
+/* Vector operations */
+lval* builtin_vec(lenv* e, lval* a);
+lval* builtin_unvec(lenv* e, lval* a);
+lval* builtin_len(lenv* e, lval* a);
+lval* builtin_nth(lenv* e, lval* a);
+lval* builtin_assoc(lenv* e, lval* a);
+lval* builtin_push(lenv* e, lval* a);
+lval* builtin_slice(lenv* e, lval* a);
+lval* builtin_concat(lenv* e, lval* a);
+
 /* Arithmetic */
-lval* builtin_op(lenv* e, lval* a, char* op);
+lval* builtin_op(lenv* e, lval* a, int op);
 lval* builtin_add(lenv* e, lval* a);
 lval* builtin_sub(lenv* e, lval* a);
 lval* builtin_mul(lenv* e, lval* a);
@@ -86,6 +102,22 @@ lval* builtin_min(lenv* e, lval* a);
 lval* builtin_max(lenv* e, lval* a);
 lval* builtin_rand(lenv* e, lval* a);
 
+/**
+ * Arithmetic taking an argument array, the list taking builtins above
+ * are adapters over these.
+ */
+lval* builtin_op_v(lenv* e, int argc, lval** argv, int op);
+lval* builtin_add_v(lenv* e, int argc, lval** argv);
+lval* builtin_sub_v(lenv* e, int argc, lval** argv);
+lval* builtin_mul_v(lenv* e, int argc, lval** argv);
+lval* builtin_div_v(lenv* e, int argc, lval** argv);
+lval* builtin_mod_v(lenv* e, int argc, lval** argv);
+lval* builtin_inc_v(lenv* e, int argc, lval** argv);
+lval* builtin_dec_v(lenv* e, int argc, lval** argv);
+lval* builtin_pow_v(lenv* e, int argc, lval** argv);
+lval* builtin_min_v(lenv* e, int argc, lval** argv);
+lval* builtin_max_v(lenv* e, int argc, lval** argv);
+
 /* Trigonometry */
 lval* builtin_sin(lenv* e, lval* a);
 lval* builtin_sinh(lenv* e, lval* a);
@@ -102,9 +134,11 @@ lval* builtin_bitwiseor(lenv* e, lval* a);
 lval* builtin_bitwisexor(lenv* e, lval* a);
 
 /* Conditionals */
-lval* builtin_ord(lenv* e, lval* a, char* op);
-lval* builtin_cmp(lenv* e, lval* a, char* op);
+lval* builtin_ord(lenv* e, lval* a, int op);
+lval* builtin_cmp(lenv* e, lval* a, int op);
 lval* builtin_if(lenv* e, lval* a);
+lval* builtin_when(lenv* e, lval* a);
+lval* builtin_cond(lenv* e, lval* a);
 lval* builtin_eq(lenv* e, lval* a);
 lval* builtin_ne(lenv* e, lval* a);
 lval* builtin_gt(lenv* e, lval* a);
@@ -113,11 +147,33 @@ lval* builtin_ge(lenv* e, lval* a);
 lval* builtin_le(lenv* e, lval* a);
 lval* builtin_and(lenv* e, lval* a);
 lval* builtin_or(lenv* e, lval* a);
+lval* builtin_and_word(lenv* e, lval* a);
+lval* builtin_or_word(lenv* e, lval* a);
 lval* builtin_not(lenv* e, lval* a);
 lval* builtin_xor(lenv* e, lval* a);
 
+/* Loops */
+lval* builtin_while(lenv* e, lval* a);
+lval* builtin_dotimes(lenv* e, lval* a);
+lval* builtin_doseq(lenv* e, lval* a);
+lval* builtin_loop(lenv* e, lval* a);
+lval* builtin_recur(lenv* e, lval* a);
+lval* builtin_let(lenv* e, lval* a);
+
+/* Conditionals taking an argument array */
+lval* builtin_ord_v(lenv* e, int argc, lval** argv, int op);
+lval* builtin_cmp_v(lenv* e, int argc, lval** argv, int op);
+lval* builtin_eq_v(lenv* e, int argc, lval** argv);
+lval* builtin_ne_v(lenv* e, int argc, lval** argv);
+lval* builtin_gt_v(lenv* e, int argc, lval** argv);
+lval* builtin_lt_v(lenv* e, int argc, lval** argv);
+lval* builtin_ge_v(lenv* e, int argc, lval** argv);
+lval* builtin_le_v(lenv* e, int argc, lval** argv);
+
 /* Other functions */
 lval* builtin_exit(lenv* e, lval* a);
 lval* builtin_set(lenv* e, lval* a);
 lval* builtin_get(lenv* e, lval* a);
 lval* builtin_version(lenv* e, lval* a);
+lval* builtin_mem(lenv* e, lval* a);
+lval* builtin_gc(lenv* e, lval* a);
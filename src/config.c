@@ -34,7 +34,10 @@
 
 config c = {
     1,
-    5
+    5,
+    1000000,
+    1,
+    1
 };
 
 /**
@@ -62,3 +65,42 @@ void set_decimal(int val)
 {
     c.decimal_count = val;
 }
+
+/**
+ * DEPTH
+ */
+int get_depth()
+{
+    return c.depth;
+}
+
+void set_depth(int val)
+{
+    c.depth = val;
+}
+
+/**
+ * VM
+ */
+int get_vm()
+{
+    return c.vm;
+}
+
+void set_vm(int val)
+{
+    c.vm = val;
+}
+
+/**
+ * FOLD
+ */
+int get_fold()
+{
+    return c.fold;
+}
+
+void set_fold(int val)
+{
+    c.fold = val;
+}
@@ -36,6 +36,9 @@ typedef struct
 {
     int splash;
     int decimal_count;
+    int depth;
+    int vm;
+    int fold;
 } config;
 #endif
 
@@ -44,3 +47,12 @@ void set_splash(int val);
 
 int get_decimal();
 void set_decimal(int val);
+
+int get_depth();
+void set_depth(int val);
+
+int get_vm();
+void set_vm(int val);
+
+int get_fold();
+void set_fold(int val);
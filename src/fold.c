@@ -0,0 +1,566 @@
+/*
+ * Lispy fold source file.
+ *
+ * @filename: fold.c
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy constant folding pass source file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "fold.h"
+#include "lval.h"
+#include "builtins.h"
+#include "config.h"
+
+/**
+ * Builtins without side effects, their calls on constant arguments are
+ * made once when a file is loaded.
+ */
+static lbuiltin fold_pure[] = {
+    builtin_add, builtin_sub, builtin_mul, builtin_div, builtin_mod,
+    builtin_inc, builtin_dec, builtin_pow, builtin_min, builtin_max,
+    builtin_ln, builtin_log, builtin_ceil, builtin_floor,
+    builtin_sin, builtin_sinh, builtin_cos, builtin_cosh, builtin_tan, builtin_tanh,
+    builtin_leftshift, builtin_rightshift,
+    builtin_bitwiseand, builtin_bitwiseor, builtin_bitwisexor,
+    builtin_eq, builtin_ne, builtin_gt, builtin_lt, builtin_ge, builtin_le,
+    builtin_and, builtin_or, builtin_and_word, builtin_or_word, builtin_not, builtin_xor
+};
+
+static int fold_named(lval* v, char* name)
+{
+    return LTYPE(v) == LVAL_SYM && strcmp(LSYM(v), name) == 0;
+}
+
+/**
+ * Noting bindings ahead. A name a file binds with def a second time,
+ * or binds with =, counts as rebound from the start. So do names that
+ * are bound already. Formals and loop variables are noted as locally
+ * bound.
+ */
+static void fold_define(lval* sym, lval* seen)
+{
+    lval* k = LSYMINTERN(sym);
+    for (int i = 0; i < LCOUNT(seen); i++) {
+        if (LCELL(seen)[i] == k) {
+            lenv_rebound(k);
+            return;
+        }
+    }
+
+    if (lenv_root && lenv_find(lenv_root, LSYM(k)) >= 0) { lenv_rebound(k); }
+    lval_add(seen, k);
+}
+
+static void fold_scan_in(lval* v, lval* seen)
+{
+    if (LTYPE(v) != LVAL_SEXPR && LTYPE(v) != LVAL_QEXPR) { return; }
+
+    int n = LCOUNT(v);
+    lval* syms = n >= 2 && LTYPE(LCELL(v)[1]) == LVAL_QEXPR ? LCELL(v)[1] : NULL;
+
+    if (syms) {
+        lval* head = LCELL(v)[0];
+        for (int i = 0; i < LCOUNT(syms); i++) {
+            lval* sym = LCELL(syms)[i];
+            if (LTYPE(sym) != LVAL_SYM) { continue; }
+
+            if (fold_named(head, "def")) {
+                fold_define(sym, seen);
+            } else if (fold_named(head, "=")) {
+                lenv_rebound(sym);
+            } else if (fold_named(head, "\\")) {
+                lenv_local(sym);
+            } else if (fold_named(head, "fun")) {
+                if (i == 0) {
+                    fold_define(sym, seen);
+                } else {
+                    lenv_local(sym);
+                }
+            } else if (fold_named(head, "loop") || fold_named(head, "dotimes") ||
+                fold_named(head, "doseq")) {
+                if (i % 2 == 0) { lenv_local(sym); }
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        fold_scan_in(LCELL(v)[i], seen);
+    }
+}
+
+void fold_scan(lval* forms)
+{
+    lval* seen = lval_qexpr();
+    fold_scan_in(forms, seen);
+    lval_del(seen);
+}
+
+/**
+ * The global value of a name, as long as nothing else can bind it. It
+ * was never bound in a local frame, which lookups could find first,
+ * and never rebound through def or =.
+ */
+lval* fold_global(lval* sym)
+{
+    lval* k = LSYMINTERN(sym);
+    if (LSYMLOCAL(k) || LSYMREBOUND(k) || lenv_root == NULL) { return NULL; }
+
+    int i = lenv_find(lenv_root, LSYM(k));
+    return i >= 0 ? lenv_root->vals[i] : NULL;
+}
+
+static int fold_const(lval* v)
+{
+    return LTYPE(v) == LVAL_NUM || LTYPE(v) == LVAL_DEC ||
+        LTYPE(v) == LVAL_BOOL || LTYPE(v) == LVAL_STR;
+}
+
+/* A condition as builtin_if decides it, or -1 when it is not constant */
+static int fold_truth(lval* v)
+{
+    if (LTYPE(v) == LVAL_BOOL) { return LBOOL(v); }
+    if (LTYPE(v) == LVAL_NUM) { return LNUM(v) > 0; }
+    return -1;
+}
+
+static int fold_is_pure(lval* f)
+{
+    if (f == NULL || LTYPE(f) != LVAL_FUN || !LBUILTIN(f)) { return 0; }
+
+    for (int i = 0; i < sizeof(fold_pure) / sizeof(fold_pure[0]); i++) {
+        if (fold_pure[i] == LBUILTIN(f)) { return 1; }
+    }
+    return 0;
+}
+
+static int fold_is_lambda(lval* f)
+{
+    return f && LTYPE(f) == LVAL_FUN && !LBUILTIN(f);
+}
+
+static lval* fold_call(lenv* e, lval* v);
+
+/* A value in a position where it is evaluated */
+static lval* fold_value(lenv* e, lval* v)
+{
+    return LTYPE(v) == LVAL_SEXPR ? fold_call(e, v) : v;
+}
+
+/**
+ * A condition, where the boolean constants true, false and otherwise
+ * are taken for their value as well. Other globals bound to a boolean
+ * may still be redefined once the file is loaded.
+ */
+static lval* fold_cond(lenv* e, lval* v)
+{
+    if (fold_named(v, "true") || fold_named(v, "false") || fold_named(v, "otherwise")) {
+        lval* g = fold_global(v);
+        if (g && LTYPE(g) == LVAL_BOOL) {
+            lval_del(v);
+            return lval_copy(g);
+        }
+    }
+    return fold_value(e, v);
+}
+
+/* A Q-Expression evaluated as an S-Expression later on, a body or a branch */
+static lval* fold_code(lenv* e, lval* v)
+{
+    return LTYPE(v) == LVAL_QEXPR ? fold_call(e, v) : v;
+}
+
+/**
+ * What an expression folded down to, in place of it. An S-Expression
+ * becomes the value itself, a body or branch a Q-Expression holding it.
+ */
+static lval* fold_result(lval* v, lval* x)
+{
+    int type = LTYPE(v);
+    lval_del(v);
+    if (type == LVAL_SEXPR) { return x; }
+
+    lval* q = lval_qexpr();
+    return lval_add(q, x);
+}
+
+/**
+ * Inlining. A call to a small lambda with fixed formals is replaced by
+ * its body, with the arguments put in place of the formals. The body
+ * may only name its formals and stable globals, and the lambdas among
+ * those may in turn only name their own formals and stable globals, so
+ * that no lookup sees a different frame than the call would have made.
+ *
+ * Those globals can still be bound anew once the file is loaded, so
+ * the inlined body is guarded: (guard {names} {body} {call}) goes back
+ * to making the call as soon as one of the names has been rebound or
+ * bound in a local frame.
+ */
+#define FOLD_INLINE_SIZE 16
+#define FOLD_INLINE_DEPTH 4
+
+static int fold_inlining = 0;
+
+/* Globals named by the body being inlined, the names its guard checks */
+static lval* fold_deps = NULL;
+
+int fold_stable(lval* names)
+{
+    for (int i = 0; i < LCOUNT(names); i++) {
+        lval* k = LSYMINTERN(LCELL(names)[i]);
+        if (LSYMLOCAL(k) || LSYMREBOUND(k)) { return 0; }
+    }
+    return 1;
+}
+
+/* The guard is a special form, the branch taken is handed back as if's is */
+static lval* fold_pick(lenv* e, lval* a)
+{
+    LASSERT_NUM("guard", a, 3);
+
+    lval* x = lval_copy(LCELL(a)[fold_stable(LCELL(a)[0]) ? 1 : 2]);
+    lval_del(a);
+    return lval_tail(e, x);
+}
+
+/* It lives outside the pools, like the shared booleans */
+static lval fold_guard = {
+    .type = LVAL_FUN, .is_builtin = 1, .special = 1, .refs = LVAL_IMMORTAL,
+    .as.fun.builtin = fold_pick
+};
+
+int fold_guarded(lval* v)
+{
+    return LTYPE(v) == LVAL_FUN && LBUILTIN(v) == fold_pick;
+}
+
+static void fold_depend(lval* sym)
+{
+    lval* k = LSYMINTERN(sym);
+    for (int i = 0; i < LCOUNT(fold_deps); i++) {
+        if (LCELL(fold_deps)[i] == k) { return; }
+    }
+    lval_add(fold_deps, k);
+}
+
+static int fold_size(lval* v)
+{
+    if (LTYPE(v) != LVAL_SEXPR && LTYPE(v) != LVAL_QEXPR) { return 1; }
+
+    int size = 1;
+    for (int i = 0; i < LCOUNT(v); i++) {
+        size += fold_size(LCELL(v)[i]);
+    }
+    return size;
+}
+
+static int fold_formal(lval* f, lval* sym)
+{
+    for (int i = 0; i < LCOUNT(LFORMALS(f)); i++) {
+        if (LSYM(LCELL(LFORMALS(f))[i]) == LSYM(sym)) { return i; }
+    }
+    return -1;
+}
+
+/**
+ * Uses of a name, those in a branch or in an argument of a special form
+ * also counted in *nested, as they may not be evaluated.
+ */
+static int fold_uses(lval* v, lval* sym, int branch, int* nested)
+{
+    if (LTYPE(v) == LVAL_SYM) {
+        int use = LSYM(v) == LSYM(sym);
+        if (use && branch) { (*nested)++; }
+        return use;
+    }
+    if (LTYPE(v) != LVAL_SEXPR && LTYPE(v) != LVAL_QEXPR) { return 0; }
+
+    lval* head = LCOUNT(v) ? LCELL(v)[0] : NULL;
+    lval* g = head && LTYPE(head) == LVAL_SYM ? fold_global(head) : NULL;
+    int special = g && LSPECIAL(g);
+
+    int uses = 0;
+    for (int i = 0; i < LCOUNT(v); i++) {
+        lval* x = LCELL(v)[i];
+        uses += fold_uses(x, sym, branch || LTYPE(x) == LVAL_QEXPR || (special && i > 0), nested);
+    }
+    return uses;
+}
+
+static int fold_closed(lval* f, lval* v, int code, int depth);
+
+static int fold_closed_sym(lval* f, lval* v, int code, int depth)
+{
+    if (fold_formal(f, v) >= 0) { return code; }
+    if (!code) { return 1; }
+
+    lval* g = fold_global(v);
+    if (g == NULL) { return 0; }
+
+    fold_depend(v);
+    if (LTYPE(g) != LVAL_FUN) { return 1; }
+
+    if (LBUILTIN(g)) {
+        return LBUILTIN(g) != builtin_lambda && LBUILTIN(g) != builtin_def &&
+            LBUILTIN(g) != builtin_put;
+    }
+    if (g == f || depth >= FOLD_INLINE_DEPTH) { return 0; }
+    return fold_closed(g, LBODY(g), 1, depth + 1);
+}
+
+/**
+ * Whether the body v of f only names what is described above. Formals
+ * may only be named in code, the branches of an if, and never in other
+ * Q-Expressions which could be data.
+ */
+static int fold_closed(lval* f, lval* v, int code, int depth)
+{
+    if (LTYPE(v) == LVAL_SYM) { return fold_closed_sym(f, v, code, depth); }
+    if (LTYPE(v) != LVAL_SEXPR && LTYPE(v) != LVAL_QEXPR) { return 1; }
+
+    lval* head = LCOUNT(v) && code ? LCELL(v)[0] : NULL;
+    lval* g = head && LTYPE(head) == LVAL_SYM ? fold_global(head) : NULL;
+    int branches = LCOUNT(v) == 4 && ((g && LTYPE(g) == LVAL_FUN && LBUILTIN(g) == builtin_if) ||
+        (head && fold_guarded(head)));
+
+    for (int i = 0; i < LCOUNT(v); i++) {
+        lval* x = LCELL(v)[i];
+        int in_code = code && (LTYPE(x) != LVAL_QEXPR || (branches && i >= 2));
+        if (!fold_closed(f, x, in_code, depth)) { return 0; }
+    }
+    return 1;
+}
+
+static lval* fold_subst(lval* v, lval* f, lval* args)
+{
+    if (LTYPE(v) == LVAL_SYM) {
+        int i = fold_formal(f, v);
+        if (i < 0) { return v; }
+
+        lval_del(v);
+        return lval_copy(LCELL(args)[i + 1]);
+    }
+    if (LTYPE(v) != LVAL_SEXPR && LTYPE(v) != LVAL_QEXPR) { return v; }
+
+    v = lval_unshare(v);
+    for (int i = 0; i < LCOUNT(v); i++) {
+        LCELL(v)[i] = fold_subst(LCELL(v)[i], f, args);
+    }
+    return v;
+}
+
+/**
+ * Whether the call v of f can be inlined. A lambda without formals is
+ * not called by (f), that is its value. An argument that is a call
+ * itself has to be used exactly once and outside the branches, so it
+ * is still evaluated once and no matter what the body does. With more
+ * than one such argument their order could change, so that is not
+ * inlined either.
+ */
+static int fold_inlines(lval* v, lval* f)
+{
+    lval* formals = LFORMALS(f);
+    int n = LCOUNT(v) - 1;
+    if (n == 0 || LBOUND(f) || LREPEATS(f) || LARITY(f) != LCOUNT(formals) || LARITY(f) != n) { return 0; }
+    if (fold_inlining >= FOLD_INLINE_DEPTH || fold_size(LBODY(f)) > FOLD_INLINE_SIZE) { return 0; }
+    if (!fold_closed(f, LBODY(f), 1, 0)) { return 0; }
+
+    int calls = 0;
+    for (int i = 0; i < n; i++) {
+        if (LTYPE(LCELL(v)[i + 1]) != LVAL_SEXPR) { continue; }
+
+        int nested = 0;
+        int uses = fold_uses(LBODY(f), LCELL(formals)[i], 0, &nested);
+        if (++calls > 1 || uses != 1 || nested) { return 0; }
+    }
+    return 1;
+}
+
+/* The call v of f inlined behind its guard, or v as it is */
+static lval* fold_inline(lenv* e, lval* v, lval* f)
+{
+    fold_deps = lval_add(lval_qexpr(), LSYMINTERN(LCELL(v)[0]));
+    if (!fold_inlines(v, f)) {
+        lval_del(fold_deps);
+        fold_deps = NULL;
+        return v;
+    }
+    lval* deps = fold_deps;
+    fold_deps = NULL;
+
+    lval* x = fold_subst(lval_copy(LBODY(f)), f, v);
+    x->type = LVAL_QEXPR;
+
+    if (get_fold() > 1) {
+        printf("Inlined ");
+        lval_print(v);
+        printf(" as ");
+        lval_println(x);
+    }
+
+    fold_inlining++;
+    x = fold_call(e, x);
+    fold_inlining--;
+
+    lval* r = lval_sexpr();
+    r->type = LTYPE(v);
+    v->type = LVAL_QEXPR;
+    lval_add(r, &fold_guard);
+    lval_add(r, deps);
+    lval_add(r, x);
+    return lval_add(r, v);
+}
+
+/**
+ * cond and select take {condition value} clauses. Clauses with a false
+ * condition are dropped, save the last one standing for the error, as
+ * is everything after a true one. Left with a true one up front, cond
+ * is replaced by its value.
+ */
+static lval* fold_select(lenv* e, lval* v)
+{
+    for (int i = 1; i < LCOUNT(v); i++) {
+        lval* c = LCELL(v)[i];
+        if (LTYPE(c) != LVAL_QEXPR || LCOUNT(c) != 2) { return v; }
+
+        c = lval_unshare(c);
+        LCELL(c)[0] = fold_cond(e, LCELL(c)[0]);
+        LCELL(c)[1] = fold_value(e, LCELL(c)[1]);
+        LCELL(v)[i] = c;
+    }
+
+    int i = 1;
+    while (i < LCOUNT(v)) {
+        int t = fold_truth(LCELL(LCELL(v)[i])[0]);
+        if (t == 0 && LCOUNT(v) > 2) {
+            lval_del(lval_pop(v, i));
+            continue;
+        }
+        i++;
+        if (t == 1) {
+            while (LCOUNT(v) > i) { lval_del(lval_pop(v, i)); }
+        }
+    }
+
+    if (LCOUNT(v) > 1 && fold_truth(LCELL(LCELL(v)[1])[0]) == 1) {
+        lval* c = LCELL(v)[1];
+        return fold_result(v, lval_copy(LCELL(c)[1]));
+    }
+    return v;
+}
+
+static lval* fold_call(lenv* e, lval* v)
+{
+    v = lval_unshare(v);
+    int n = LCOUNT(v);
+    if (n == 0) { return v; }
+
+    lval* head = LCELL(v)[0];
+    lval* f = LTYPE(head) == LVAL_SYM ? fold_global(head) : NULL;
+    if (f && LTYPE(f) != LVAL_FUN) { f = NULL; }
+
+    /* An inlined call, its fallback is the call as it was */
+    if (n == 4 && fold_guarded(head)) {
+        LCELL(v)[2] = fold_code(e, LCELL(v)[2]);
+        return v;
+    }
+
+    /* Bodies of lambdas, with their formals left alone */
+    if (n == 3 && LTYPE(LCELL(v)[1]) == LVAL_QEXPR &&
+        ((f && LBUILTIN(f) == builtin_lambda) || (fold_named(head, "fun") && fold_is_lambda(f)))) {
+        LCELL(v)[2] = fold_code(e, LCELL(v)[2]);
+        return v;
+    }
+
+    if (LTYPE(head) == LVAL_SEXPR) {
+        LCELL(v)[0] = fold_call(e, head);
+    }
+    for (int i = 1; i < n; i++) {
+        LCELL(v)[i] = fold_value(e, LCELL(v)[i]);
+    }
+
+    /* An if on a constant condition is replaced by the branch taken */
+    if (n == 4 && f && LBUILTIN(f) == builtin_if) {
+        LCELL(v)[1] = fold_cond(e, LCELL(v)[1]);
+        LCELL(v)[2] = fold_code(e, LCELL(v)[2]);
+        LCELL(v)[3] = fold_code(e, LCELL(v)[3]);
+
+        int t = fold_truth(LCELL(v)[1]);
+        if (t < 0) { return v; }
+
+        /**
+         * A Q-Expression branch is code in place of the if, a constant
+         * its value. A name or a call is left be, it is run as code
+         * should its value turn out to be a Q-Expression.
+         */
+        int pick = t == 1 ? 2 : 3;
+        if (LTYPE(LCELL(v)[pick]) == LVAL_SYM || LTYPE(LCELL(v)[pick]) == LVAL_SEXPR) { return v; }
+        if (LTYPE(LCELL(v)[pick]) != LVAL_QEXPR) {
+            return fold_result(v, lval_copy(LCELL(v)[pick]));
+        }
+
+        int type = LTYPE(v);
+        lval* x = lval_take(v, pick);
+        x->type = type;
+        return x;
+    }
+
+    if (f && LBUILTIN(f) == builtin_cond) {
+        return fold_select(e, v);
+    }
+
+    if (f && LBUILTIN(f) == builtin_let && n == 2) {
+        LCELL(v)[1] = fold_code(e, LCELL(v)[1]);
+        return v;
+    }
+
+    if (fold_is_lambda(f)) {
+        return fold_inline(e, v, f);
+    }
+
+    /* A pure builtin on constants, errors are left to happen at runtime */
+    if (n < 2 || !fold_is_pure(f)) { return v; }
+    for (int i = 1; i < n; i++) {
+        if (!fold_const(LCELL(v)[i])) { return v; }
+    }
+
+    lval* a = lval_sexpr();
+    for (int i = 1; i < n; i++) {
+        lval_add(a, lval_copy(LCELL(v)[i]));
+    }
+    lval* x = LBUILTIN(f)(e, a);
+    if (LTYPE(x) == LVAL_ERR) {
+        lval_del(x);
+        return v;
+    }
+    return fold_result(v, x);
+}
+
+lval* fold_form(lenv* e, lval* v)
+{
+    if (!get_fold()) { return v; }
+    return fold_value(e, v);
+}
@@ -0,0 +1,60 @@
+/**
+ * Lispy fold header file
+ *
+ * @filename: fold.h
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy constant folding pass header file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LSPY_FOLD_HEADER
+#define LSPY_FOLD_HEADER
+
+#include "structures.h"
+
+/**
+ * Note the names the forms of a file read by lval_read are going to
+ * bind, before any of them is folded.
+ */
+void fold_scan(lval* forms);
+
+/* Fold a top-level form right before it is evaluated in e */
+lval* fold_form(lenv* e, lval* v);
+
+/**
+ * The global value of sym, or NULL when a local frame or a second def
+ * could have bound it to something else by the time it is looked up.
+ */
+lval* fold_global(lval* sym);
+
+/**
+ * Inlined calls are guarded by a special form of their own, which the
+ * vm runs in place. It takes the inlined body as long as none of the
+ * names it relied on has been bound anew since.
+ */
+int fold_guarded(lval* f);
+int fold_stable(lval* names);
+#endif
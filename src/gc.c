@@ -0,0 +1,315 @@
+/*
+ * Lispy garbage collector source file.
+ *
+ * @filename: gc.c
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy mark and sweep garbage collector source file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gc.h"
+#include "pool.h"
+#include "hashtable.h"
+#include "vm.h"
+
+/**
+ * Values and environments are freed by reference counting as soon as
+ * their last reference goes, which is nearly always. What counting can
+ * not see is a cycle, a lambda bound in the very frame it captured
+ * keeps that frame alive and the frame the lambda. The collector owns
+ * those: it only frees what nothing reachable refers to, and runs
+ * seldom, when the pools have doubled since the last run. The cycles
+ * still around when a top-level form is done go with its region.
+ *
+ * Roots are the global environment plus everything the evaluator has
+ * pushed on its root stacks. A collection only runs at points where
+ * every live value is reachable from one of those.
+ */
+static lenv* global_env = NULL;
+
+static lval** roots = NULL;
+static int root_count = 0;
+static int root_cap = 0;
+
+static lenv** env_roots = NULL;
+static int env_root_count = 0;
+static int env_root_cap = 0;
+
+/* Gray stack, lenvs are tagged with the low bit */
+static uintptr_t* gray = NULL;
+static int gray_count = 0;
+static int gray_cap = 0;
+
+static long threshold = GC_MIN_HEAP;
+static long collections = 0;
+static long freed_total = 0;
+static long freed_last = 0;
+
+void gc_init(lenv* global)
+{
+    global_env = global;
+}
+
+void gc_push(lval* v)
+{
+    if (root_count == root_cap) {
+        root_cap = root_cap ? root_cap * 2 : 256;
+        roots = realloc(roots, sizeof(lval*) * root_cap);
+    }
+    roots[root_count++] = v;
+}
+
+void gc_pop(int n)
+{
+    root_count -= n;
+}
+
+void gc_push_env(lenv* e)
+{
+    if (env_root_count == env_root_cap) {
+        env_root_cap = env_root_cap ? env_root_cap * 2 : 256;
+        env_roots = realloc(env_roots, sizeof(lenv*) * env_root_cap);
+    }
+    env_roots[env_root_count++] = e;
+}
+
+void gc_pop_env(void)
+{
+    env_root_count--;
+}
+
+static void gray_push(uintptr_t p)
+{
+    if (gray_count == gray_cap) {
+        gray_cap = gray_cap ? gray_cap * 2 : 1024;
+        gray = realloc(gray, sizeof(uintptr_t) * gray_cap);
+    }
+    gray[gray_count++] = p;
+}
+
+static void mark_lval(lval* v)
+{
+    if (v == NULL || LIMM(v) || v->mark) { return; }
+    v->mark = 1;
+    gray_push((uintptr_t)v);
+}
+
+static void mark_lenv(lenv* e)
+{
+    if (e == NULL || e->mark) { return; }
+    e->mark = 1;
+    gray_push((uintptr_t)e | 1);
+}
+
+static void mark_children(void)
+{
+    while (gray_count) {
+        uintptr_t p = gray[--gray_count];
+
+        if (p & 1) {
+            lenv* e = (lenv*)(p & ~(uintptr_t)1);
+            for (int i = 0; i < e->count; i++) {
+                mark_lval(e->vals[i]);
+            }
+            mark_lenv(e->par);
+            continue;
+        }
+
+        lval* v = (lval*)p;
+        switch (LTYPE(v)) {
+            case LVAL_FUN:
+                if (!LBUILTIN(v)) {
+                    mark_lenv(LENV(v));
+                    mark_lval(LFORMALS(v));
+                    mark_lval(LBODY(v));
+                    if (LCODE(v)) { mark_lval(LCODE(v)->consts); }
+                }
+                break;
+            case LVAL_SEXPR:
+            case LVAL_QEXPR:
+                if (LVIEW(v)) {
+                    mark_lval(LOWNER(v));
+                    break;
+                }
+                for (int i = 0; i < LCOUNT(v); i++) {
+                    mark_lval(LCELL(v)[i]);
+                }
+                break;
+            case LVAL_VEC:
+                mark_lval(LVLEFT(v));
+                mark_lval(LVITEM(v));
+                mark_lval(LVRIGHT(v));
+                break;
+        }
+    }
+}
+
+/**
+ * Garbage may still hold references to live objects. Hand those back
+ * before sweeping, so the survivors keep an honest reference count.
+ */
+static void release_live_lval(lval* v)
+{
+    if (v && !LIMM(v) && v->mark && v->refs != LVAL_IMMORTAL) { v->refs--; }
+}
+
+static void release_live_lenv(lenv* e)
+{
+    if (e && e->mark) { e->refs--; }
+}
+
+/* Code is shared by reference count and freed with its last lambda */
+static void release_live_code(lcode* c)
+{
+    if (c && --c->refs == 0) {
+        release_live_lval(c->consts);
+        free(c->ops);
+        free(c);
+    }
+}
+
+static void drop_lval(void* ptr)
+{
+    lval* v = ptr;
+    if (v->mark) { return; }
+
+    switch (LTYPE(v)) {
+        case LVAL_FUN:
+            if (!LBUILTIN(v)) {
+                release_live_lenv(LENV(v));
+                release_live_lval(LFORMALS(v));
+                release_live_lval(LBODY(v));
+                release_live_code(LCODE(v));
+            }
+            break;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            if (LVIEW(v)) {
+                release_live_lval(LOWNER(v));
+                break;
+            }
+            for (int i = 0; i < LCOUNT(v); i++) {
+                release_live_lval(LCELL(v)[i]);
+            }
+            break;
+        case LVAL_VEC:
+            release_live_lval(LVLEFT(v));
+            release_live_lval(LVITEM(v));
+            release_live_lval(LVRIGHT(v));
+            break;
+    }
+}
+
+static void drop_lenv(void* ptr)
+{
+    lenv* e = ptr;
+    if (e->mark) { return; }
+
+    for (int i = 0; i < e->count; i++) {
+        release_live_lval(e->vals[i]);
+    }
+    release_live_lenv(e->par);
+}
+
+static void sweep_lval(void* ptr)
+{
+    lval* v = ptr;
+
+    if (v->mark) {
+        v->mark = 0;
+        return;
+    }
+
+    switch (LTYPE(v)) {
+        case LVAL_ERR: free(LERR(v)); break;
+        case LVAL_STR: free(LSTR(v)); break;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            if (!LVIEW(v) && LCELL(v) != LINLINE(v)) { free(LCELL(v)); }
+            break;
+    }
+    pool_free(&lval_pool, v);
+    freed_last++;
+}
+
+static void sweep_lenv(void* ptr)
+{
+    lenv* e = ptr;
+
+    if (e->mark) {
+        e->mark = 0;
+        return;
+    }
+
+    free(e->syms);
+    free(e->vals);
+    hash_index_del(e->index);
+    pool_free(&lenv_pool, e);
+    freed_last++;
+}
+
+long gc_collect(void)
+{
+    mark_lenv(global_env);
+    for (int i = 0; i < env_root_count; i++) {
+        mark_lenv(env_roots[i]);
+    }
+    for (int i = 0; i < root_count; i++) {
+        mark_lval(roots[i]);
+    }
+    mark_children();
+
+    pool_foreach(&lval_pool, drop_lval);
+    pool_foreach(&lenv_pool, drop_lenv);
+
+    freed_last = 0;
+    pool_foreach(&lval_pool, sweep_lval);
+    pool_foreach(&lenv_pool, sweep_lenv);
+
+    /* Let the heap grow to twice the surviving set before the next run */
+    long live = lval_pool.used + lenv_pool.used;
+    threshold = live * 2 > GC_MIN_HEAP ? live * 2 : GC_MIN_HEAP;
+
+    collections++;
+    freed_total += freed_last;
+    return freed_last;
+}
+
+void gc_maybe_collect(void)
+{
+    if (lval_pool.used + lenv_pool.used >= threshold) {
+        gc_collect();
+    }
+}
+
+void gc_print_stats(void)
+{
+    printf("gc: %li collections, %li objects freed (%li last run), next run at %li objects\n",
+            collections, freed_total, freed_last, threshold);
+}
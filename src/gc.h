@@ -0,0 +1,52 @@
+/**
+ * Lispy garbage collector header file
+ *
+ * @filename: gc.h
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy mark and sweep garbage collector header file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LSPY_GC_HEADER
+#define LSPY_GC_HEADER
+
+#include "structures.h"
+
+/* Never collect below this many live objects */
+#ifndef GC_MIN_HEAP
+#define GC_MIN_HEAP 65536
+#endif
+
+void gc_init(lenv* global);
+void gc_push(lval* v);
+void gc_pop(int n);
+void gc_push_env(lenv* e);
+void gc_pop_env(void);
+
+void gc_maybe_collect(void);
+long gc_collect(void);
+void gc_print_stats(void);
+#endif
@@ -45,37 +45,62 @@ struct hash_table* create_hash_table(int size)
     if (new_table->table == NULL) { return NULL; }
 
     for (int i = 0; i<size; i++) {
-        new_table->table[i] = '\0';
+        new_table->table[i] = NULL;
     }
 
     new_table->size = size;
+    new_table->count = 0;
 
     return new_table;
 }
 
-unsigned int hash(struct hash_table* table, lval* v)
+unsigned int hash(struct hash_table* table, char* s)
 {
-    unsigned int hashval = 0;
+    /* FNV-1a over the symbol name */
+    unsigned int hashval = 2166136261u;
 
-    // find unique information and generate int
+    for (; *s; s++) {
+        hashval ^= (unsigned char)*s;
+        hashval *= 16777619u;
+    }
 
     return (hashval % table->size);
 }
 
-struct list* lookup_hashed_lval(struct hash_table* table, unsigned int val, lval* v)
+struct list* lookup_hashed_lval(struct hash_table* table, unsigned int val, char* s)
 {
-    struct list* new_list = malloc(sizeof(struct list));
-    if (new_list == NULL) { return NULL; }
-
-    // find lval
+    for (struct list* l = table->table[val]; l; l = l->next) {
+        if (strcmp(LSYM(l->lval), s) == 0) { return l; }
+    }
     return NULL;
 }
 
+static void rehash(struct hash_table* table)
+{
+    int old_size = table->size;
+    struct list** old = table->table;
+
+    table->size = old_size * 2;
+    table->table = calloc(table->size, sizeof(struct list *));
+
+    for (int i = 0; i < old_size; i++) {
+        struct list* l = old[i];
+        while (l) {
+            struct list* next = l->next;
+            unsigned int hashval = hash(table, LSYM(l->lval));
+            l->next = table->table[hashval];
+            table->table[hashval] = l;
+            l = next;
+        }
+    }
+    free(old);
+}
+
 int add_lval(struct hash_table* table, lval* v)
 {
-    unsigned int hashval = hash(table, v);
+    unsigned int hashval = hash(table, LSYM(v));
 
-    if (lookup_hashed_lval(table, hashval, v)) { return 2; }
+    if (lookup_hashed_lval(table, hashval, LSYM(v))) { return 2; }
 
     struct list* new_list = malloc(sizeof(struct list));
 
@@ -86,5 +111,62 @@ int add_lval(struct hash_table* table, lval* v)
 
     table->table[hashval] = new_list;
 
+    /* Keep the chains short */
+    if (++table->count > table->size) { rehash(table); }
+
     return 0;
 }
+
+unsigned int hash_ptr(void* p)
+{
+    /* Names are interned, so the address identifies the symbol */
+    unsigned long h = (unsigned long)p >> 3;
+    h *= 0x9e3779b97f4a7c15UL;
+    return (unsigned int)(h >> 32);
+}
+
+int hash_index_find(struct hash_index* index, char** keys, char* key)
+{
+    unsigned int mask = index->size - 1;
+
+    for (unsigned int i = hash_ptr(key) & mask; index->slots[i]; i = (i + 1) & mask) {
+        int pos = index->slots[i] - 1;
+        if (keys[pos] == key) { return pos; }
+    }
+    return -1;
+}
+
+void hash_index_add(struct hash_index* index, char** keys, int pos)
+{
+    unsigned int mask = index->size - 1;
+    unsigned int i = hash_ptr(keys[pos]) & mask;
+
+    while (index->slots[i]) { i = (i + 1) & mask; }
+    index->slots[i] = pos + 1;
+}
+
+struct hash_index* hash_index_build(struct hash_index* index, char** keys, int count)
+{
+    int size = 16;
+    while (size < count * 2) { size *= 2; }
+
+    if (index == NULL) {
+        index = malloc(sizeof(struct hash_index));
+    } else {
+        free(index->slots);
+    }
+    index->size = size;
+    index->slots = calloc(size, sizeof(int));
+
+    for (int i = 0; i < count; i++) {
+        hash_index_add(index, keys, i);
+    }
+    return index;
+}
+
+void hash_index_del(struct hash_index* index)
+{
+    if (index == NULL) { return; }
+    free(index->slots);
+    free(index);
+}
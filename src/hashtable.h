@@ -30,6 +30,9 @@
  *
  */
 
+#ifndef LSPY_HASHTABLE_HEADER
+#define LSPY_HASHTABLE_HEADER
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,6 +40,9 @@
 
 #include "lval.h"
 
+/* Initial bucket count of the symbol table, it doubles as it fills */
+#define LSPY_SYMBOLS 256
+
 struct list 
 {
     lval* lval;
@@ -46,10 +52,29 @@ struct list
 struct hash_table
 {
     int size;
+    int count;
     struct list** table;
 };
 
+/**
+ * Open addressing index over an array of interned names. Every slot
+ * holds a position in the array plus one, zero marks an empty slot.
+ * The slot count is a power of two and kept at most half full.
+ */
+struct hash_index
+{
+    int size;
+    int* slots;
+};
+
 struct hash_table* create_hash_table(int size);
-unsigned int hash(struct hash_table* table, lval* v);
-struct list* lookup_hashed_lval(struct hash_table* table, unsigned int val, lval* v);
+unsigned int hash(struct hash_table* table, char* s);
+struct list* lookup_hashed_lval(struct hash_table* table, unsigned int val, char* s);
 int add_lval(struct hash_table* table, lval* v);
+
+unsigned int hash_ptr(void* p);
+int hash_index_find(struct hash_index* index, char** keys, char* key);
+void hash_index_add(struct hash_index* index, char** keys, int pos);
+struct hash_index* hash_index_build(struct hash_index* index, char** keys, int count);
+void hash_index_del(struct hash_index* index);
+#endif
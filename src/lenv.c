@@ -34,31 +34,64 @@
 #include "lval.h"
 #include "hashtable.h"
 
+/* The global environment and the stamp of its set of bindings */
+lenv* lenv_root = NULL;
+unsigned int lenv_version = 1;
+
+/**
+ * The stamp of the frame layouts resolved symbols were made for. It
+ * moves on once a special form the resolver went by is bound anew, or
+ * once a name resolved into an outer frame is bound by = in a frame in
+ * between, where the lookup would find it first.
+ */
+unsigned int lenv_layout = 1;
+
+void lenv_init(lenv* global)
+{
+    lenv_root = global;
+}
+
 lenv* lenv_new(void)
 {
-    lenv* e = malloc(sizeof(lenv));
+    lenv* e = pool_alloc(&lenv_pool);
+    e->mark = 0;
+    e->refs = 1;
     e->par = NULL;
     e->count = 0;
     e->syms = NULL;
     e->vals = NULL;
+    e->index = NULL;
     return e;
 }
 
 lenv* lenv_copy(lenv* e)
 {
-    lenv* n = malloc(sizeof(lenv));
-    n->par = e->par;
-    n->count = e->count;
-    n->syms = malloc(sizeof(char*) * n->count);
-    n->vals = malloc(sizeof(lval*) * n->count);
+    lenv* n = lenv_frame(e, e->count);
+    n->index = e->index ? hash_index_build(NULL, n->syms, n->count) : NULL;
+    return n;
+}
+
+/**
+ * A frame for a call, holding the bindings of e and with room for n
+ * bindings in all, to be filled in with lenv_bind.
+ */
+lenv* lenv_frame(lenv* e, int n)
+{
+    lenv* f = pool_alloc(&lenv_pool);
+    f->mark = 0;
+    f->refs = 1;
+    f->par = e->par;
+    f->count = e->count;
+    f->index = NULL;
+    if (f->par) { f->par->refs++; }
+    f->syms = n ? malloc(sizeof(char*) * n) : NULL;
+    f->vals = n ? malloc(sizeof(lval*) * n) : NULL;
 
     for (int i = 0; i < e->count; i++) {
-        n->syms[i] = malloc(strlen(e->syms[i]) + 1);
-        strcpy(n->syms[i], e->syms[i]);
-        n->vals[i] = lval_copy(e->vals[i]);
+        f->syms[i] = e->syms[i];
+        f->vals[i] = lval_copy(e->vals[i]);
     }
-
-    return n;
+    return f;
 }
 
 void lenv_def(lenv* e, lval* k, lval* v)
@@ -70,42 +103,115 @@ void lenv_def(lenv* e, lval* k, lval* v)
     lenv_put(e, k, v);
 }
 
+int lenv_find(lenv* e, char* sym)
+{
+    if (e->index) {
+        return hash_index_find(e->index, e->syms, sym);
+    }
+
+    for (int i = 0; i < e->count; i++) {
+        if (e->syms[i] == sym) { return i; }
+    }
+    return -1;
+}
+
+/* Note that = added a name to a local frame, one more to walk past */
+static void lenv_shadow(lval* k)
+{
+    lval* sym = LSYMINTERN(k);
+    if (!LSYMSHADOWED(sym)) {
+        LSYMSHADOWED(sym) = 1;
+        if (LSYMOUTER(sym)) { lenv_layout++; }
+    }
+}
+
 void lenv_put(lenv* e, lval* k, lval* v)
 {
     /**
-     * Iterate over all items in the environment.
-     * This is to see if the variable already exists.
+     * Binding a name outside the global environment, or adding a global
+     * binding, invalidates the global slots cached on symbols.
      */
-    for (int i = 0; i < e->count; i++) {
-        /**
-         * If variable is found, delete item at that position,
-         * and replace it with variable supplied.
-         */
-        if (strcmp(e->syms[i], k->sym) == 0) {
-            lval_del(e->vals[i]);
-            e->vals[i] = lval_copy(v);
-            return;
-        }
+    if (e != lenv_root) { lenv_local(k); }
+
+    /**
+     * If the variable already exists, delete the item at that
+     * position and replace it with the variable supplied.
+     */
+    int i = lenv_find(e, LSYM(k));
+    if (i >= 0) {
+        lval* old = e->vals[i];
+        e->vals[i] = lval_escape(e, v);
+        lval_del(old);
+        return;
     }
 
     /* No match found */
+    if (e != lenv_root) { lenv_shadow(k); }
     e->count++;
     e->vals = realloc(e->vals, sizeof(lval*) * e->count);
     e->syms = realloc(e->syms, sizeof(char*) * e->count);
 
-    /* Copy contents of lval and symbol into new location */
-    e->vals[e->count - 1] = lval_copy(v);
-    e->syms[e->count - 1] = malloc(strlen(k->sym) + 1);
-    strcpy(e->syms[e->count - 1], k->sym);
+    /* Keep a reference to the value and the interned symbol name */
+    e->vals[e->count - 1] = lval_escape(e, v);
+    e->syms[e->count - 1] = LSYM(k);
+    if (e == lenv_root) { lenv_version++; }
+
+    /* Index the names once the frame is too big to scan */
+    if (e->index && e->count * 2 <= e->index->size) {
+        hash_index_add(e->index, e->syms, e->count - 1);
+    } else if (e->count > LENV_LINEAR) {
+        e->index = hash_index_build(e->index, e->syms, e->count);
+    }
+}
+
+/**
+ * Add a binding of sym, known not to be in a frame from lenv_frame yet,
+ * into the room reserved for it. Takes over v.
+ */
+void lenv_bind(lenv* e, char* sym, lval* v)
+{
+    e->syms[e->count] = sym;
+    e->vals[e->count] = v;
+    e->count++;
+
+    if (e->index && e->count * 2 <= e->index->size) {
+        hash_index_add(e->index, e->syms, e->count - 1);
+    } else if (e->count > LENV_LINEAR) {
+        e->index = hash_index_build(e->index, e->syms, e->count);
+    }
+}
+
+/* Note that a name is bound in a local frame, see lenv_get */
+void lenv_local(lval* k)
+{
+    lval* sym = LSYMINTERN(k);
+    if (!LSYMLOCAL(sym)) {
+        LSYMLOCAL(sym) = 1;
+        lenv_version++;
+        if (LSYMTRUSTED(sym)) { lenv_layout++; }
+    }
+}
+
+/* Note that a name is bound once more with def or = */
+void lenv_rebound(lval* k)
+{
+    lval* sym = LSYMINTERN(k);
+    if (!LSYMREBOUND(sym)) {
+        LSYMREBOUND(sym) = 1;
+        if (LSYMTRUSTED(sym)) { lenv_layout++; }
+    }
 }
 
 void lenv_del(lenv* e)
 {
+    if (--e->refs > 0) { return; }
+
     for (int i = 0; i < e->count; i++) {
-        free(e->syms[i]);
         lval_del(e->vals[i]);
     }
     free(e->syms);
     free(e->vals);
-    free(e);
+    hash_index_del(e->index);
+    if (e->par) { lenv_del(e->par); }
+    pool_free(&lenv_pool, e);
 }
@@ -36,10 +36,21 @@
 
 #include "structures.h"
 #include "macros.h"
+#include "pool.h"
 
+extern lenv* lenv_root;
+extern unsigned int lenv_version;
+extern unsigned int lenv_layout;
+
+void lenv_init(lenv* global);
 lenv* lenv_new(void);
 lenv* lenv_copy(lenv* e);
+lenv* lenv_frame(lenv* e, int n);
 
+int lenv_find(lenv* e, char* sym);
 void lenv_def(lenv* e, lval* k, lval* v);
 void lenv_put(lenv* e, lval* k, lval* v);
+void lenv_bind(lenv* e, char* sym, lval* v);
+void lenv_local(lval* k);
+void lenv_rebound(lval* k);
 void lenv_del(lenv* e);
@@ -34,6 +34,7 @@
 #include "builtins.h"
 #include "version.h"
 #include "config.h"
+#include "gc.h"
 
 void completion(const char *buf, linenoiseCompletions *lc)
 {
@@ -112,6 +113,8 @@ int main(int argc, char** argv)
       Symbol, Sexpr, Qexpr, Expr, Lispy);
 
     lenv* e = lenv_new();
+    lenv_init(e);
+    gc_init(e);
     lenv_add_builtins(e);
 
     /**
@@ -120,7 +123,7 @@ int main(int argc, char** argv)
     sprintf(stdlib_path, "%s/%s", GLIB_PFIX, "std.lspy");
     lval* stdlib_file = lval_add(lval_sexpr(), lval_str(stdlib_path));
     lval* stdlib_load = builtin_load(e, stdlib_file);
-    if (stdlib_load->type == LVAL_ERR) {
+    if (LTYPE(stdlib_load) == LVAL_ERR) {
         lval_println(stdlib_load);
     }
     lval_del(stdlib_load);
@@ -132,7 +135,7 @@ int main(int argc, char** argv)
         sprintf(settings_path, "%s", getenv("LISPY_DEFAULT"));
         lval* settings_file = lval_add(lval_sexpr(), lval_str(settings_path));
         lval* settings_load = builtin_load(e, settings_file);
-        if (settings_load->type == LVAL_ERR) {
+        if (LTYPE(settings_load) == LVAL_ERR) {
             lval_println(settings_load);
         }
         lval_del(settings_load);
@@ -155,9 +158,11 @@ int main(int argc, char** argv)
                 mpc_result_t r;
                 if (mpc_parse("<stdin>", input, Lispy, &r)) {
 
+                    lval_region_begin(e);
                     lval* x = lval_eval(e, lval_read(r.output));
                     lval_println(x);
                     lval_del(x);
+                    lval_region_end();
                     mpc_ast_delete(r.output);
                 } else {
                     mpc_err_print(r.error);
@@ -179,7 +184,7 @@ int main(int argc, char** argv)
 
             lval* x = builtin_load(e, args);
 
-            if (x->type == LVAL_ERR) {
+            if (LTYPE(x) == LVAL_ERR) {
                 lval_println(x);
             }
             lval_del(x);
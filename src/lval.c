@@ -30,179 +30,695 @@
  *
  */
 
+#include <assert.h>
+
 #include "lval.h"
 #include "builtins.h"
 #include "config.h"
+#include "fold.h"
+#include "gc.h"
+#include "hashtable.h"
+#include "vm.h"
+
+static lval* lval_new(int type)
+{
+    lval* v = pool_alloc(&lval_pool);
+    v->type = type;
+    v->is_builtin = 0;
+    v->mark = 0;
+    v->special = 0;
+    v->refs = 1;
+    return v;
+}
 
 lval* lval_fun(lbuiltin func)
 {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_FUN;
-    v->builtin = func;
+    lval* v = lval_new(LVAL_FUN);
+    LBUILTIN(v) = func;
+    LBUILTINV(v) = NULL;
     return v;
 }
 
+static int lval_is_rest(lval* sym);
+
+/**
+ * The number of formals before '&', or -1 when '&' is not followed by a
+ * single symbol. Frames are filled without lenv_put, so the formals are
+ * noted as locally bound here instead.
+ */
+static int lval_arity(lval* formals)
+{
+    int arity = LCOUNT(formals);
+
+    for (int i = 0; i < LCOUNT(formals); i++) {
+        lval* sym = LCELL(formals)[i];
+        if (lval_is_rest(sym)) {
+            if (arity < LCOUNT(formals) || LCOUNT(formals) - i != 2) { return -1; }
+            arity = i;
+            continue;
+        }
+        lenv_local(sym);
+    }
+    return arity;
+}
+
+/* Whether a name occurs more than once, the last binding of it wins */
+static int lval_repeats(lval* formals)
+{
+    for (int i = 0; i < LCOUNT(formals); i++) {
+        for (int j = 0; j < i; j++) {
+            if (LSYM(LCELL(formals)[i]) == LSYM(LCELL(formals)[j])) { return 1; }
+        }
+    }
+    return 0;
+}
+
 lval* lval_lambda(lval* formals, lval* body)
 {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_FUN;
+    lval* v = lval_new(LVAL_FUN);
 
-    v->builtin = NULL;
+    LBUILTIN(v) = NULL;
 
-    v->env = lenv_new();
-    v->formals = formals;
-    v->body = body;
+    LENV(v) = lenv_new();
+    LFORMALS(v) = formals;
+    LBODY(v) = body;
+    LCODE(v) = NULL;
+    LARITY(v) = lval_arity(formals);
+    LBOUND(v) = 0;
+    LREPEATS(v) = lval_repeats(formals);
     return v;
 }
 
+/**
+ * Booleans are shared immortal values. They live outside the pools, so
+ * producing one never allocates.
+ */
+static lval lval_false = { .type = LVAL_BOOL, .refs = LVAL_IMMORTAL, .as.bool = 0 };
+static lval lval_true = { .type = LVAL_BOOL, .refs = LVAL_IMMORTAL, .as.bool = 1 };
+
 lval* lval_bool(int val)
 {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_BOOL;
-    v->bool = val;
-
-    return v;
+    return val ? &lval_true : &lval_false;
 }
 
+/* Integers from -2^62 up to 2^62 are immediate */
+#define LVAL_IMM_MAX (1L << 62)
+
 lval* lval_num(long x)
 {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_NUM;
-    v->num = x;
+    if (x >= -LVAL_IMM_MAX && x < LVAL_IMM_MAX) {
+        return (lval*)(((uintptr_t)x << 1) | LVAL_IMM_INT);
+    }
+
+    lval* v = lval_new(LVAL_NUM);
+    v->as.num = x;
     return v;
 }
 
+/**
+ * An immediate decimal is the double rotated left by one, bringing the
+ * sign down to the lowest bit and the 11 bit exponent up top. Exponents
+ * of 2^-254 up to 2^256 are then rebased to fit in 9 bits, which leaves
+ * room for the tag below. Zero, of either sign, is kept as rebased
+ * exponent 0; the other numbers there, and all beyond, are allocated.
+ */
+#define LVAL_DEC_BIAS ((uint64_t)768 << 53)
+#define LVAL_DEC_SPAN ((uint64_t)512 << 53)
+
 lval* lval_dec(double x)
 {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_DEC;
-    v->decimal = x;
+    uint64_t b;
+    memcpy(&b, &x, sizeof(b));
+    uint64_t r = (b << 1) | (b >> 63);
+
+    if (r <= 1) {
+        return (lval*)(uintptr_t)((r << 2) | LVAL_IMM_DEC);
+    }
+    if (r >= LVAL_DEC_BIAS + ((uint64_t)1 << 53) && r < LVAL_DEC_BIAS + LVAL_DEC_SPAN) {
+        return (lval*)(uintptr_t)(((r - LVAL_DEC_BIAS) << 2) | LVAL_IMM_DEC);
+    }
+
+    lval* v = lval_new(LVAL_DEC);
+    v->as.decimal = x;
     return v;
 }
 
+double lval_imm_dec(lval* v)
+{
+    uint64_t r = (uint64_t)(uintptr_t)v >> 2;
+    if (r > 1) { r += LVAL_DEC_BIAS; }
+
+    uint64_t b = (r >> 1) | (r << 63);
+    double x;
+    memcpy(&x, &b, sizeof(x));
+    return x;
+}
+
 lval* lval_str(char* s)
 {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_STR;
-    v->str = malloc(strlen(s) + 1);
-    strcpy(v->str, s);
+    lval* v = lval_new(LVAL_STR);
+    LSTR(v) = malloc(strlen(s) + 1);
+    strcpy(LSTR(v), s);
     return v;
 }
 
 lval* lval_err(char* fmt, ...)
 {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_ERR;
+    lval* v = lval_new(LVAL_ERR);
 
     va_list va;
     va_start(va, fmt);
 
-    v->err = malloc(512);
+    LERR(v) = malloc(512);
 
-    vsnprintf(v->err, 511, fmt, va);
+    vsnprintf(LERR(v), 511, fmt, va);
 
-    v->err = realloc(v->err, strlen(v->err)+1);
+    LERR(v) = realloc(LERR(v), strlen(LERR(v))+1);
 
     va_end(va);
 
     return v;
 }
 
+/**
+ * Symbols are interned, every name maps to one immortal value. Two
+ * symbols are equal exactly when their names are the same pointer.
+ */
+static struct hash_table* symbols = NULL;
+
 lval* lval_sym(char* s)
 {
+    if (symbols == NULL) { symbols = create_hash_table(LSPY_SYMBOLS); }
+
+    struct list* l = lookup_hashed_lval(symbols, hash(symbols, s), s);
+    if (l) { return l->lval; }
+
+    /* Interned symbols live outside the pools, the collector never frees them */
     lval* v = malloc(sizeof(lval));
     v->type = LVAL_SYM;
-    v->sym = malloc(strlen(s) + 1);
-    strcpy(v->sym, s);
+    v->is_builtin = 0;
+    v->mark = 0;
+    v->special = 0;
+    v->refs = LVAL_IMMORTAL;
+    LSYM(v) = malloc(strlen(s) + 1);
+    strcpy(LSYM(v), s);
+    LSYMINTERN(v) = v;
+    LSYMDEPTH(v) = -1;
+    LSYMSLOT(v) = 0;
+    LSYMGLOBAL(v) = 0;
+    LSYMVERSION(v) = 0;
+    LSYMLOCAL(v) = 0;
+    LSYMREBOUND(v) = 0;
+    LSYMTRUSTED(v) = 0;
+    LSYMOUTER(v) = 0;
+    LSYMSHADOWED(v) = 0;
+
+    add_lval(symbols, v);
     return v;
 }
 
-lval* lval_sexpr(void)
+static int lval_is_rest(lval* sym)
 {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_SEXPR;
-    v->count = 0;
-    v->cell = NULL;
+    static lval* rest = NULL;
+    if (rest == NULL) { rest = lval_sym("&"); }
+
+    return LSYM(sym) == LSYM(rest);
+}
+
+/**
+ * Make room for at least n cells. Short expressions use the inline
+ * cells, after that the heap buffer grows geometrically.
+ */
+static void lval_reserve(lval* v, int n)
+{
+    if (LVIEW(v)) {
+        /* Take private references to the cells before changing them */
+        lval* owner = LOWNER(v);
+        lval** cell = LCELL(v);
+        int count = LCOUNT(v);
+
+        LCAP(v) = LVAL_INLINE_CELLS;
+        LCELL(v) = LINLINE(v);
+        LCOUNT(v) = 0;
+        lval_reserve(v, n > count ? n : count);
+
+        for (int i = 0; i < count; i++) {
+            LCELL(v)[i] = lval_copy(cell[i]);
+        }
+        LCOUNT(v) = count;
+        lval_del(owner);
+        return;
+    }
+
+    if (n <= LCAP(v)) { return; }
+
+    int cap = LCAP(v) * 2;
+    if (cap < n) { cap = n; }
+
+    if (LCELL(v) == LINLINE(v)) {
+        LCELL(v) = malloc(sizeof(lval*) * cap);
+        memcpy(LCELL(v), LINLINE(v), sizeof(lval*) * LCOUNT(v));
+    } else {
+        LCELL(v) = realloc(LCELL(v), sizeof(lval*) * cap);
+    }
+    LCAP(v) = cap;
+}
+
+static void lval_expr_init(lval* v, int n)
+{
+    LCOUNT(v) = 0;
+    LCAP(v) = LVAL_INLINE_CELLS;
+    LCELL(v) = LINLINE(v);
+    lval_reserve(v, n);
+}
+
+static lval* lval_expr(int type, int n)
+{
+    lval* v = lval_new(type);
+    lval_expr_init(v, n);
     return v;
 }
 
+lval* lval_sexpr(void)
+{
+    return lval_expr(LVAL_SEXPR, 0);
+}
+
 lval* lval_qexpr(void)
 {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_QEXPR;
-    v->count = 0;
-    v->cell = NULL;
-    return v;
+    return lval_expr(LVAL_QEXPR, 0);
 }
 
 lval* lval_add(lval* v, lval* x)
 {
-    v->count++;
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
-    v->cell[v->count-1] = x;
+    lval_reserve(v, LCOUNT(v) + 1);
+    LCELL(v)[LCOUNT(v)++] = x;
     return v;
 }
 
 lval* lval_eval(lenv* e, lval* v)
 {
-    if (v->type == LVAL_SYM) {
+    if (LTYPE(v) == LVAL_SYM) {
         lval* x = lenv_get(e, v);
         lval_del(v);
         return x;
     }
-    if (v->type == LVAL_SEXPR) {
-        return lval_eval_sexpr(e, v);
+    if (LTYPE(v) == LVAL_SEXPR) {
+        lval* x = lval_eval_sexpr(e, v);
+        lval_del(v);
+        return x;
     }
     return v;
 }
 
-lval* lval_eval_sexpr(lenv*e, lval* v)
+/**
+ * Tail position requests. While lval_eval_sexpr calls a builtin it
+ * sets tail_ok, a builtin whose result is the evaluation of another
+ * expression hands that expression over through lval_tail instead of
+ * evaluating it on the C stack.
+ */
+static int tail_ok = 0;
+static lval* tail_expr = NULL;
+
+lval* lval_tail(lenv* e, lval* x)
+{
+    if (tail_ok) {
+        tail_ok = 0;
+        tail_expr = x;
+        return NULL;
+    }
+
+    lval* r = lval_eval_sexpr(e, x);
+    lval_del(x);
+    return r;
+}
+
+static lval* lval_bind(lenv* e, lval* f, lval* a, lenv** frame);
+
+/**
+ * Evaluation stack. Every S-Expression being evaluated has a record
+ * here instead of a native stack frame: the expression, the values of
+ * the cells evaluated so far and the environment to evaluate in. Deep
+ * recursion grows this array on the heap, and is cut off with an error
+ * once it holds more records than the "depth" setting allows.
+ *
+ * A compiled lambda body runs in a record of its own, with code set,
+ * the constants of the code as expression and args as operand stack.
+ */
+typedef struct
+{
+    lval* expr;
+    lval* args;
+    lenv* env;
+    int next;
+
+    lcode* code;
+    int pc;
+
+    /* Whether env is the frame of a call made by this record */
+    int frame;
+} lcont;
+
+static lcont* stack = NULL;
+static int stack_count = 0;
+static int stack_cap = 0;
+
+/* Set when a record could not be pushed for lack of depth */
+static int overflow = 0;
+
+/**
+ * Push a record evaluating v in e, or running code when v are its
+ * constants. Takes over v and code.
+ */
+static int lcont_push(lenv* e, lval* v, lcode* code)
+{
+    int depth = get_depth();
+    if (depth > 0 && stack_count >= depth) {
+        lval_del(v);
+        if (code) { vm_release(code); }
+        overflow = 1;
+        return 0;
+    }
+
+    if (stack_count == stack_cap) {
+        stack_cap = stack_cap ? stack_cap * 2 : 256;
+        stack = realloc(stack, sizeof(lcont) * stack_cap);
+    }
+
+    lcont* k = &stack[stack_count++];
+    k->expr = v;
+    k->args = lval_sexpr();
+    k->env = e;
+    k->next = 0;
+    k->code = code;
+    k->pc = 0;
+    k->frame = 0;
+
+    /* The arguments only stay rooted until they are applied */
+    gc_push(k->expr);
+    gc_push(k->args);
+    return 1;
+}
+
+static void lcont_pop(void)
+{
+    lcont* k = &stack[--stack_count];
+
+    if (k->args) {
+        gc_pop(1);
+        lval_del(k->args);
+    }
+    gc_pop(1);
+    lval_del(k->expr);
+    if (k->code) { vm_release(k->code); }
+
+    if (k->frame) {
+        gc_pop_env();
+        lenv_del(k->env);
+    }
+}
+
+/**
+ * Carry on with x in place of the expression of the top record, or with
+ * code when x are its constants.
+ */
+static void lcont_replace(lval* x, lcode* code)
 {
-    /* Evaluate children */
-    for (int i = 0; i < v->count; i++) {
-        v->cell[i] = lval_eval(e, v->cell[i]);
+    lcont* k = &stack[stack_count - 1];
+
+    if (k->args) {
+        gc_pop(1);
+        lval_del(k->args);
     }
+    gc_pop(1);
+    lval_del(k->expr);
+    if (k->code) { vm_release(k->code); }
+
+    k->expr = x;
+    k->args = lval_sexpr();
+    k->next = 0;
+    k->code = code;
+    k->pc = 0;
+    gc_push(k->expr);
+    gc_push(k->args);
+}
+
+/**
+ * Apply the evaluated argument list a for the top record. As a tail
+ * call the top record ends with the call, otherwise the call is made
+ * on top of it. Returns the value of the call, or NULL when a record
+ * has been set up to evaluate it instead.
+ *
+ * This is the one place functions are applied. A builtin that has code
+ * evaluated hands it back with lval_tail, or runs lval_eval, which
+ * nests a run of the loop below that ends up here as well.
+ */
+static lval* lcont_apply(lval* a, int tail)
+{
+    gc_push(a);
+    gc_maybe_collect();
+    gc_pop(1);
+
+    lcont* k = &stack[stack_count - 1];
+    lenv* e = k->env;
 
     /* Error checking */
-    for (int i = 0; i < v->count; i++) {
-        if (v->cell[i]->type == LVAL_ERR) {
-            return lval_take(v, i);
+    for (int i = 0; i < LCOUNT(a); i++) {
+        if (LTYPE(LCELL(a)[i]) == LVAL_ERR) {
+            return lval_take(a, i);
         }
     }
 
     /* Empty expression */
-    if (v->count == 0) { return v; }
+    if (LCOUNT(a) == 0) { return a; }
+
+    /**
+     * Single expression. Its cell has been evaluated already, a symbol
+     * here is the value of a name and is not looked up once more.
+     */
+    if (LCOUNT(a) == 1) {
+        lval* x = lval_take(a, 0);
+        if (LTYPE(x) == LVAL_SEXPR) {
+            if (tail) {
+                lcont_replace(x, NULL);
+            } else {
+                lcont_push(e, x, NULL);
+            }
+            return NULL;
+        }
+        return x;
+    }
 
-    /* Single expression */
-    if (v->count == 1) { return lval_eval(e, lval_take(v, 0)); }
+    /* Builtins taking an argument array are called on the list in place */
+    lval* f = LCELL(a)[0];
+    if (LTYPE(f) == LVAL_FUN && LBUILTIN(f) && LBUILTINV(f)) {
+        lval* r = LBUILTINV(f)(e, LCOUNT(a) - 1, LCELL(a) + 1);
+        lval_del(a);
+        return r;
+    }
 
     /* Ensure first element is symbol */
-    lval* f = lval_pop(v, 0);
-    if (f->type != LVAL_FUN) {
+    f = lval_pop(a, 0);
+    if (LTYPE(f) != LVAL_FUN) {
         lval* err = lval_err(
                 "S-Expression starts with incorrect type. Got %s, expected %s.",
-                ltype_name(f->type), ltype_name(LVAL_FUN));
-        lval_del(v);
+                ltype_name(LTYPE(f)), ltype_name(LVAL_FUN));
+        lval_del(a);
         lval_del(f);
         return err;
     }
 
-    /* Call builtin with operator */
-    lval* result = lval_call(e, f, v);
+    /**
+     * Call builtin with operator. The call consumes a, keep a reference
+     * of our own for as long as it sits on the root stack.
+     */
+    gc_push(f);
+    gc_push(lval_copy(a));
+
+    lval* result;
+    lval* next = NULL;
+    lcode* code = NULL;
+    lenv* frame = NULL;
+    if (LBUILTIN(f)) {
+        tail_ok = 1;
+        result = LBUILTIN(f)(e, a);
+        tail_ok = 0;
+        if (result == NULL) {
+            next = tail_expr;
+            tail_expr = NULL;
+        }
+    } else {
+        result = lval_bind(e, f, a, &frame);
+        if (frame && LCODE(f) && get_vm()) {
+            code = LCODE(f);
+            vm_retain(code);
+            next = lval_copy(code->consts);
+        } else if (frame) {
+            next = lval_copy(LBODY(f));
+        }
+    }
+
+    gc_pop(2);
+    lval_del(a);
     lval_del(f);
-    return result;
+    if (next == NULL) { return result; }
+
+    /* A builtin may have run the evaluator itself and moved the stack */
+    k = &stack[stack_count - 1];
+
+    /* A builtin handing back an expression has it evaluated in its place */
+    if (frame == NULL) {
+        if (tail) {
+            lcont_replace(next, NULL);
+        } else {
+            lcont_push(e, next, NULL);
+        }
+        return NULL;
+    }
+
+    if (!tail) {
+        if (!lcont_push(frame, next, code)) {
+            lenv_del(frame);
+            return NULL;
+        }
+        gc_push_env(frame);
+        stack[stack_count - 1].frame = 1;
+        return NULL;
+    }
+
+    /**
+     * Tail call, carry on with the body in the same record. The frame
+     * of the caller is done with, it is let go of unless a closure
+     * holds on to it.
+     */
+    if (k->frame) {
+        gc_pop_env();
+        lenv_del(e);
+    }
+    gc_push_env(frame);
+    k->frame = 1;
+    k->env = frame;
+
+    lcont_replace(next, code);
+    return NULL;
+}
+
+/**
+ * The expression may be shared (a lambda body, a stored Q-Expression),
+ * so its cells are evaluated into a fresh argument list instead of in
+ * place. Whatever type v carries, it is evaluated as an S-Expression,
+ * or code is run with v as its constants. A tail call replaces the
+ * record's reference to v, the caller still holds one so v stays rooted
+ * until the evaluation is done.
+ */
+static lval* lval_eval_run(lenv* e, lval* v, lcode* code)
+{
+    int base = stack_count;
+    gc_push(v);
+    lcont_push(e, lval_copy(v), code);
+
+    /* A builtin evaluating on its own keeps its tail request for after */
+    int tail = tail_ok;
+    tail_ok = 0;
+
+    for (;;) {
+        if (overflow) {
+            /* Out of depth, unwind everything this call put on the stack */
+            overflow = 0;
+            while (stack_count > base) { lcont_pop(); }
+            gc_pop(1);
+            tail_ok = tail;
+            return lval_err("Maximum recursion depth of %i exceeded.", get_depth());
+        }
+
+        lcont* k = &stack[stack_count - 1];
+        lval* r;
+
+        if (k->code) {
+            /**
+             * Compiled code returns to us for calls. A call that does not
+             * need a record of its own has its value pushed right back.
+             */
+            int status = vm_run(k->code, &k->pc, k->env, k->args, &r);
+            if (status != VM_RETURN) {
+                r = lcont_apply(r, status == VM_TAIL);
+                if (r == NULL) { continue; }
+                if (status == VM_CALL) {
+                    lval_add(stack[stack_count - 1].args, r);
+                    continue;
+                }
+            }
+        } else if (k->next < LCOUNT(k->expr)) {
+            /* A special form gets the rest of the cells as they are */
+            if (k->next == 1 && LSPECIAL(LCELL(k->args)[0])) {
+                while (k->next < LCOUNT(k->expr)) {
+                    lval_add(k->args, lval_copy(LCELL(k->expr)[k->next++]));
+                }
+                continue;
+            }
+
+            lval* x = LCELL(k->expr)[k->next++];
+
+            if (LTYPE(x) == LVAL_SEXPR) {
+                lcont_push(k->env, lval_copy(x), NULL);
+                continue;
+            }
+
+            r = LTYPE(x) == LVAL_SYM ? lenv_get(k->env, x) : lval_copy(x);
+            lval_add(k->args, r);
+            continue;
+        } else {
+            lval* a = k->args;
+            k->args = NULL;
+            gc_pop(1);
+            r = lcont_apply(a, 1);
+            if (r == NULL) { continue; }
+        }
+
+        lcont_pop();
+        if (stack_count == base) {
+            gc_pop(1);
+            tail_ok = tail;
+            return r;
+        }
+        lval_add(stack[stack_count - 1].args, r);
+    }
+}
+
+lval* lval_eval_sexpr(lenv* e, lval* v)
+{
+    return lval_eval_run(e, v, NULL);
+}
+
+/* Run code compiled by vm_compile in e, as a body is run */
+lval* lval_eval_code(lenv* e, lcode* code)
+{
+    vm_retain(code);
+    return lval_eval_run(e, code->consts, code);
 }
 
 lval* lval_pop(lval* v, int i)
 {
-    lval* x = v->cell[i];
+    if (LVIEW(v)) {
+        /* Popping either end of a view just narrows the window */
+        if (i == 0) {
+            LCOUNT(v)--;
+            return lval_copy(*LCELL(v)++);
+        }
+        if (i == LCOUNT(v) - 1) {
+            LCOUNT(v)--;
+            return lval_copy(LCELL(v)[i]);
+        }
+        lval_reserve(v, LCOUNT(v));
+    }
+
+    lval* x = LCELL(v)[i];
     
     /* Shift the memory following the item at "i" over the top if it */
-    memmove(&v->cell[i], &v->cell[i+1], sizeof(lval*) * (v->count-i-1));
+    memmove(&LCELL(v)[i], &LCELL(v)[i+1], sizeof(lval*) * (LCOUNT(v)-i-1));
 
-    v->count--;
-
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+    /* Keep the capacity, the expression is usually popped empty */
+    LCOUNT(v)--;
 
     return x;
 }
@@ -216,15 +732,46 @@ lval* lval_take(lval* v, int i)
 
 lval* lval_join(lval* x, lval* y)
 {
-    /* for each cell in y, add it to x */
-    while (y->count) {
-        x = lval_add(x, lval_pop(y, 0));
+    /* Append all cells of y to x in one go */
+    lval_reserve(x, LCOUNT(x) + LCOUNT(y));
+
+    if (y->refs == 1 && !LVIEW(y)) {
+        /* Nobody else sees y, move the cells over */
+        memcpy(&LCELL(x)[LCOUNT(x)], LCELL(y), sizeof(lval*) * LCOUNT(y));
+        LCOUNT(x) += LCOUNT(y);
+        LCOUNT(y) = 0;
+    } else {
+        for (int i = 0; i < LCOUNT(y); i++) {
+            LCELL(x)[LCOUNT(x)++] = lval_copy(LCELL(y)[i]);
+        }
     }
 
     lval_del(y);
     return x;
 }
 
+lval* lval_slice(lval* v, int start, int end)
+{
+    int n = end - start;
+
+    /* Short slices are copied, longer ones share the cells of v */
+    if (n <= LVAL_INLINE_CELLS) {
+        lval* x = lval_expr(LTYPE(v), n);
+        for (int i = 0; i < n; i++) {
+            LCELL(x)[i] = lval_copy(LCELL(v)[start + i]);
+        }
+        LCOUNT(x) = n;
+        return x;
+    }
+
+    lval* x = lval_new(LTYPE(v));
+    LCOUNT(x) = n;
+    LCAP(x) = 0;
+    LCELL(x) = LCELL(v) + start;
+    LOWNER(x) = lval_copy(LVIEW(v) ? LOWNER(v) : v);
+    return x;
+}
+
 lval* lval_range(long x, long y)
 {
     lval* v = NULL;
@@ -305,220 +852,784 @@ lval* lval_read(mpc_ast_t* t)
 
 lval* lval_copy(lval* v)
 {
-    lval* x = malloc(sizeof(lval));
-    x->type = v->type;
+    /**
+     * Values are shared and reference counted, a copy is just another
+     * reference. Use lval_unshare before changing a value in place.
+     */
+    if (!LIMM(v) && v->refs != LVAL_IMMORTAL) { v->refs++; }
+    return v;
+}
+
+lval* lval_unshare(lval* v)
+{
+    if (LIMM(v)) { return v; }
+
+    /**
+     * A view shares its cells, so it is never private. Nor is a value
+     * from before the current region, which may not point into it.
+     */
+    int view = (LTYPE(v) == LVAL_SEXPR || LTYPE(v) == LVAL_QEXPR) && LVIEW(v);
+    if (v->refs == 1 && !view && !pool_outlives_region(&lval_pool, v)) { return v; }
+
+    lval* x = lval_dup(v);
+    lval_del(v);
+    return x;
+}
+
+lval* lval_dup(lval* v)
+{
+    if (LIMM(v)) { return v; }
+
+    lval* x = lval_new(LTYPE(v));
     x->is_builtin = v->is_builtin;
+    x->special = v->special;
 
-    switch (v->type) {
+    switch (LTYPE(v)) {
         case LVAL_FUN:
-            if (v->builtin) {
-                x->builtin = v->builtin;
+            LBUILTIN(x) = LBUILTIN(v);
+            if (LBUILTIN(v)) {
+                LBUILTINV(x) = LBUILTINV(v);
             } else {
-                x->builtin = NULL;
-                x->env = lenv_copy(v->env);
-                x->formals = lval_copy(v->formals);
-                x->body = lval_copy(v->body);
+                LENV(x) = LENV(v);
+                LENV(x)->refs++;
+                LFORMALS(x) = lval_copy(LFORMALS(v));
+                LBODY(x) = lval_copy(LBODY(v));
+                LCODE(x) = LCODE(v);
+                if (LCODE(x)) { vm_retain(LCODE(x)); }
+                LARITY(x) = LARITY(v);
+                LBOUND(x) = LBOUND(v);
+                LREPEATS(x) = LREPEATS(v);
             }
             break;
         case LVAL_NUM:
-            x->num = v->num;
+            x->as.num = v->as.num;
             break;
         case LVAL_DEC:
-            x->decimal = v->decimal;
+            x->as.decimal = v->as.decimal;
             break;
         case LVAL_BOOL:
-            x->bool = v->bool;
+            LBOOL(x) = LBOOL(v);
             break;
         case LVAL_STR:
-            x->str = malloc(strlen(v->str) + 1);
-            strcpy(x->str, v->str);
+            LSTR(x) = malloc(strlen(LSTR(v)) + 1);
+            strcpy(LSTR(x), LSTR(v));
             break;
         case LVAL_ERR:
-            x->err = malloc(strlen(v->err) + 1);
-            strcpy(x->err, v->err);
+            LERR(x) = malloc(strlen(LERR(v)) + 1);
+            strcpy(LERR(x), LERR(v));
             break;
         case LVAL_SYM:
-            x->sym = malloc(strlen(v->sym) + 1);
-            strcpy(x->sym, v->sym);
+            x->as.sym = v->as.sym;
             break;
         case LVAL_SEXPR:
         case LVAL_QEXPR:
-            x->count = v->count;
-            x->cell = malloc(sizeof(lval*) * x->count);
-            for (int i = 0; i < x->count; i++) {
-                x->cell[i] = lval_copy(v->cell[i]);
+            lval_expr_init(x, LCOUNT(v));
+            LCOUNT(x) = LCOUNT(v);
+            for (int i = 0; i < LCOUNT(x); i++) {
+                LCELL(x)[i] = lval_copy(LCELL(v)[i]);
             }
             break;
+        case LVAL_VEC:
+            x->as.vec = v->as.vec;
+            if (LVLEFT(x)) { lval_copy(LVLEFT(x)); }
+            if (LVITEM(x)) { lval_copy(LVITEM(x)); }
+            if (LVRIGHT(x)) { lval_copy(LVRIGHT(x)); }
+            break;
     }
 
     return x;
 }
 
-lval* lval_call(lenv* e, lval* f, lval* a)
+/* Root environment of the region the current top-level form runs in */
+static lenv* region_env = NULL;
+
+void lval_region_begin(lenv* e)
 {
-    if (f->builtin) {
-        return f->builtin(e, a);
+    if (lval_pool.region == 0) {
+        while (e->par) { e = e->par; }
+        region_env = e;
     }
+    pool_region_begin(&lval_pool);
+    pool_region_begin(&lenv_pool);
+}
+
+/**
+ * What a value left over in a region holds outside of it has one
+ * reference less. One that would drop to none is garbage along with
+ * the region and left to the collector, freeing it here could reach
+ * back into the slabs being reset.
+ */
+static void lval_region_release(lval* v)
+{
+    if (v == NULL || LIMM(v) || v->refs == LVAL_IMMORTAL) { return; }
+    if (!pool_in_region(&lval_pool, v) && v->refs > 1) { v->refs--; }
+}
+
+static void lenv_region_release(lenv* e)
+{
+    if (e && !pool_in_region(&lenv_pool, e) && e->refs > 1) { e->refs--; }
+}
 
-    int given = a->count;
-    int total = f->formals->count;
+/* Let go of the memory and outside values of a leftover region value */
+static void lval_region_drop(void* ptr)
+{
+    lval* v = ptr;
+    switch (LTYPE(v)) {
+        case LVAL_ERR: free(LERR(v)); break;
+        case LVAL_STR: free(LSTR(v)); break;
+        case LVAL_FUN:
+            if (!LBUILTIN(v)) {
+                lenv_region_release(LENV(v));
+                lval_region_release(LFORMALS(v));
+                lval_region_release(LBODY(v));
+                if (LCODE(v) && --LCODE(v)->refs == 0) {
+                    lval_region_release(LCODE(v)->consts);
+                    free(LCODE(v)->ops);
+                    free(LCODE(v));
+                }
+            }
+            break;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            if (LVIEW(v)) {
+                lval_region_release(LOWNER(v));
+                break;
+            }
+            for (int i = 0; i < LCOUNT(v); i++) {
+                lval_region_release(LCELL(v)[i]);
+            }
+            if (LCELL(v) != LINLINE(v)) { free(LCELL(v)); }
+            break;
+        case LVAL_VEC:
+            lval_region_release(LVLEFT(v));
+            lval_region_release(LVITEM(v));
+            lval_region_release(LVRIGHT(v));
+            break;
+    }
+}
 
-    while (a->count) {
-        if (f->formals->count == 0) {
-            lval_del(a);
-            return lval_err("Function passed to many arguments. Got %i, expected %i",
-                    given, total);
+static void lenv_region_drop(void* ptr)
+{
+    lenv* e = ptr;
+    for (int i = 0; i < e->count; i++) {
+        lval_region_release(e->vals[i]);
+    }
+    lenv_region_release(e->par);
+    free(e->syms);
+    free(e->vals);
+    hash_index_del(e->index);
+}
+
+/**
+ * Ending the outermost region resets its slabs in bulk. Values are
+ * still freed one by one as their references go, the reset takes what
+ * is left, the cycles the collector would otherwise have to find.
+ */
+void lval_region_end(void)
+{
+    pool_region_end(&lval_pool, lval_region_drop);
+    pool_region_end(&lenv_pool, lenv_region_drop);
+}
+
+static lval* lval_promote(lval* v);
+
+static void lval_promote_at(lval** slot)
+{
+    lval* old = *slot;
+    if (old) {
+        *slot = lval_promote(old);
+        lval_del(old);
+    }
+}
+
+/* Environments copied out of the region by the current lval_escape */
+static lenv** promoted = NULL;
+static int promoted_count = 0;
+static int promoted_cap = 0;
+
+/**
+ * Copy an environment living in the region out of it, along with the
+ * chain of parents a closure keeps reachable. A frame may hold closures
+ * over itself, so each one is copied once per escape and shared after.
+ * Returns a new reference.
+ */
+static lenv* lval_promote_env(lenv* e)
+{
+    if (!pool_in_region(&lenv_pool, e)) {
+        e->refs++;
+        return e;
+    }
+
+    for (int i = 0; i < promoted_count; i += 2) {
+        if (promoted[i] == e) {
+            promoted[i + 1]->refs++;
+            return promoted[i + 1];
         }
+    }
 
-        lval* sym = lval_pop(f->formals, 0);
+    lenv* n = lenv_copy(e);
+    if (promoted_count == promoted_cap) {
+        promoted_cap = promoted_cap ? promoted_cap * 2 : 16;
+        promoted = realloc(promoted, sizeof(lenv*) * promoted_cap);
+    }
+    promoted[promoted_count++] = e;
+    promoted[promoted_count++] = n;
 
-        if (strcmp(sym->sym, "&") == 0) {
-            if (f->formals->count != 1) {
-                lval_del(a);
-                return lval_err("Function format is invalid. "
-                        "Symbol '&' not followed by single symbol.");
-            }
+    if (n->par) {
+        lenv* par = n->par;
+        n->par = lval_promote_env(par);
+        lenv_del(par);
+    }
+    for (int i = 0; i < n->count; i++) {
+        lval_promote_at(&n->vals[i]);
+    }
+    return n;
+}
 
-            lval* nsym = lval_pop(f->formals, 0);
-            lenv_put(f->env, nsym, builtin_list(e, a));
-            lval_del(sym);
-            lval_del(nsym);
+/**
+ * Copy the parts of v living in the region out of it, so that storing
+ * a value globally does not keep the region slabs alive. Values outside
+ * the region are kept, but their children are promoted in place, which
+ * swaps them for equal values and is not visible to other holders.
+ */
+static lval* lval_promote(lval* v)
+{
+    if (LIMM(v) || v->refs == LVAL_IMMORTAL) { return v; }
+
+    lval* x = pool_in_region(&lval_pool, v) ? lval_dup(v) : lval_copy(v);
+
+    switch (LTYPE(x)) {
+        case LVAL_FUN:
+            if (!LBUILTIN(x)) {
+                /**
+                 * The environment and the frames it was captured in go
+                 * along, or they would keep their region slabs alive.
+                 */
+                lenv* env = LENV(x);
+                LENV(x) = lval_promote_env(env);
+                lenv_del(env);
+                lval_promote_at(&LFORMALS(x));
+                lval_promote_at(&LBODY(x));
+                if (LCODE(x)) { lval_promote_at(&LCODE(x)->consts); }
+            }
             break;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            for (int i = 0; i < LCOUNT(x); i++) {
+                lval_promote_at(&LCELL(x)[i]);
+            }
+            break;
+        case LVAL_VEC:
+            lval_promote_at(&LVLEFT(x));
+            lval_promote_at(&LVITEM(x));
+            lval_promote_at(&LVRIGHT(x));
+            break;
+    }
+
+    return x;
+}
+
+lval* lval_escape(lenv* e, lval* v)
+{
+    if (lval_pool.region == 0 || e != region_env) {
+        return lval_copy(v);
+    }
+
+    /* Promoted values are allocated outside of the region */
+    int depth = lval_pool.region;
+    lval_pool.region = lenv_pool.region = 0;
+    lval* x = lval_promote(v);
+    lval_pool.region = lenv_pool.region = depth;
+    promoted_count = 0;
+    return x;
+}
+
+/**
+ * The names bound in each frame around a reference, innermost first.
+ * Lambda formals and loop variables are bound in order into a frame of
+ * their own, one name every stride cells of names, and while the values
+ * of loop run only the first count of them are bound so far. Where a
+ * name is bound twice the lookup picks the slot, such a frame is left
+ * to it altogether.
+ */
+typedef struct lscope
+{
+    lval* names;
+    int stride;
+    int count;
+    int repeats;
+    struct lscope* up;
+} lscope;
+
+static lscope lval_scope(lval* names, int stride, lscope* up)
+{
+    lscope s = { names, stride, 0, 0, up };
+    for (int i = 0; i < LCOUNT(names); i += stride) {
+        lval* sym = LCELL(names)[i];
+        if (LTYPE(sym) != LVAL_SYM) {
+            s.repeats = 1;
+            continue;
         }
-        lval* val = lval_pop(a, 0);
+        if (stride == 1 && lval_is_rest(sym)) { continue; }
 
-        lenv_put(f->env, sym, val);
+        for (int j = 0; j < i; j += stride) {
+            lval* other = LCELL(names)[j];
+            if (LTYPE(other) == LVAL_SYM && LSYM(other) == LSYM(sym)) { s.repeats = 1; }
+        }
+        s.count++;
+    }
+    return s;
+}
 
-        lval_del(sym);
-        lval_del(val);
+static int lval_slot_of(lscope* s, char* name)
+{
+    /* The '&' marker among formals takes no slot */
+    int slot = 0;
+    for (int i = 0; i < LCOUNT(s->names) && slot < s->count; i += s->stride) {
+        lval* sym = LCELL(s->names)[i];
+        if (LTYPE(sym) == LVAL_SYM) {
+            if (s->stride == 1 && lval_is_rest(sym)) { continue; }
+            if (LSYM(sym) == name) { return slot; }
+        }
+        slot++;
     }
+    return -1;
+}
 
-    lval_del(a);
+static int lval_scoped(lscope* scope, char* name)
+{
+    for (lscope* s = scope; s; s = s->up) {
+        if (lval_slot_of(s, name) >= 0) { return 1; }
+    }
+    return 0;
+}
+
+static lval* lval_resolve_sym(lval* v, lscope* scope)
+{
+    lval* k = LSYMINTERN(v);
+    int depth = 0;
+    for (lscope* s = scope; s; s = s->up, depth++) {
+        int slot = lval_slot_of(s, LSYM(v));
+        if (slot < 0) { continue; }
+
+        /* A name bound by = in a frame in between could come first */
+        if (s->repeats || (depth > 0 && LSYMSHADOWED(k))) { return lval_copy(k); }
+        if (depth > 0) { LSYMOUTER(k) = 1; }
+
+        lval* x = lval_new(LVAL_SYM);
+        x->as.sym = v->as.sym;
+        LSYMDEPTH(x) = depth;
+        LSYMSLOT(x) = slot;
+        LSYMVERSION(x) = lenv_layout;
+        return x;
+    }
+    return lval_copy(v);
+}
+
+/**
+ * What an expression is to the resolver. Anything but a call is one of
+ * the special forms, named by a global binding that is the builtin and
+ * nothing else can take the place of.
+ */
+enum { LFORM_CALL, LFORM_OPAQUE, LFORM_LAMBDA, LFORM_BRANCH, LFORM_COND,
+       LFORM_WHILE, LFORM_EACH, LFORM_LOOP, LFORM_LET };
+
+static int lval_form(lval* v, lscope* scope)
+{
+    int n = LCOUNT(v);
+    lval* head = LCELL(v)[0];
+    if (fold_guarded(head)) { return LFORM_BRANCH; }
+
+    /**
+     * A call shaped like a loop, (f {binding} body), could be one once
+     * f is bound to it. Unless f is a global its body is left alone.
+     */
+    int shaped = n == 3 && LTYPE(LCELL(v)[1]) == LVAL_QEXPR;
+    lval* g = LTYPE(head) == LVAL_SYM && !lval_scoped(scope, LSYM(head)) ? fold_global(head) : NULL;
+    if (g == NULL) { return shaped ? LFORM_OPAQUE : LFORM_CALL; }
+
+    lbuiltin b = LTYPE(g) == LVAL_FUN ? LBUILTIN(g) : NULL;
+    int form = shaped ? LFORM_CALL : -1;
+    if (b == builtin_if || b == builtin_when) { form = LFORM_BRANCH; }
+    if (b == builtin_cond) { form = n == 4 && LTYPE(LCELL(v)[1]) != LVAL_QEXPR ? LFORM_BRANCH : LFORM_COND; }
+    if (b == builtin_while) { form = LFORM_WHILE; }
+    if (b == builtin_dotimes || b == builtin_doseq) { form = LFORM_EACH; }
+    if (b == builtin_loop) { form = LFORM_LOOP; }
+    if (b == builtin_let && n == 2 && LTYPE(LCELL(v)[1]) == LVAL_QEXPR) { form = LFORM_LET; }
+    if (b == builtin_lambda && shaped && LTYPE(LCELL(v)[2]) == LVAL_QEXPR) { form = LFORM_LAMBDA; }
+    if (form < 0) { return LFORM_CALL; }
+
+    /* Binding the name anew from now on stales what was resolved so far */
+    LSYMTRUSTED(LSYMINTERN(head)) = 1;
+    return form;
+}
+
+static lval* lval_resolve_in(lval* v, lscope* scope);
+
+/* An argument is evaluated where it stands, a Q-Expression is data */
+static lval* lval_resolve_arg(lval* v, lscope* scope)
+{
+    return LTYPE(v) == LVAL_QEXPR ? lval_copy(v) : lval_resolve_in(v, scope);
+}
 
-    if (f->formals->count > 0 &&
-        strcmp(f->formals->cell[0]->sym, "&") == 0) {
+/* Put r as cell i of x, the copy of v made as soon as a cell changes */
+static void lval_resolved(lval* v, lval** x, int i, lval* r)
+{
+    if (*x == NULL && r == LCELL(v)[i]) {
+        lval_del(r);
+        return;
+    }
+
+    /* The expression may be shared, so it is copied */
+    if (*x == NULL) {
+        *x = lval_expr(LTYPE(v), LCOUNT(v));
+        for (int j = 0; j < i; j++) {
+            lval_add(*x, lval_copy(LCELL(v)[j]));
+        }
+    }
+    lval_add(*x, r);
+}
 
-        if (f->formals->count != 2) {
-            return lval_err("Function format invalid. "
-                    "Symbol '&' not followed by single symbol");
+/**
+ * The binding of a loop. The count of dotimes and doseq is evaluated
+ * outside of the loop frame, each value of loop inside it with the
+ * names before it bound.
+ */
+static lval* lval_resolve_binding(lval* b, lscope* scope, int form)
+{
+    lscope inner = lval_scope(b, 2, scope);
+    lval* x = NULL;
+    for (int i = 0; i < LCOUNT(b); i++) {
+        lval* c = LCELL(b)[i];
+        lval* r;
+        if (i % 2 == 0) {
+            r = lval_copy(c);
+        } else if (form == LFORM_LOOP) {
+            inner.count = i / 2;
+            r = lval_resolve_arg(c, &inner);
+        } else {
+            r = lval_resolve_arg(c, scope);
         }
-        lval_del(lval_pop(f->formals, 0));
+        lval_resolved(b, &x, i, r);
+    }
+    return x ? x : lval_copy(b);
+}
 
-        lval* sym = lval_pop(f->formals, 0);
-        lval* val = lval_qexpr();
+/* A cond clause, {condition value}, both evaluated where they stand */
+static lval* lval_resolve_clause(lval* c, lscope* scope)
+{
+    if (LTYPE(c) != LVAL_QEXPR || LCOUNT(c) != 2) { return lval_copy(c); }
 
-        lenv_put(f->env, sym, val);
-        lval_del(sym);
-        lval_del(val);
+    lval* x = NULL;
+    for (int i = 0; i < 2; i++) {
+        lval_resolved(c, &x, i, lval_resolve_arg(LCELL(c)[i], scope));
     }
+    return x ? x : lval_copy(c);
+}
 
-    if (f->formals->count == 0) {
-        f->env->par = e;
-        return builtin_eval(f->env, lval_add(lval_sexpr(), lval_copy(f->body)));
+/* A reference, or an expression evaluated as an S-Expression */
+static lval* lval_resolve_in(lval* v, lscope* scope)
+{
+    if (LTYPE(v) == LVAL_SYM) { return lval_resolve_sym(v, scope); }
+    if ((LTYPE(v) != LVAL_SEXPR && LTYPE(v) != LVAL_QEXPR) || LCOUNT(v) == 0) {
+        return lval_copy(v);
+    }
+
+    int n = LCOUNT(v);
+    int form = lval_form(v, scope);
+
+    /* The bodies of lambdas, loops and let are one frame further down */
+    lscope inner;
+    if (form == LFORM_LAMBDA) { inner = lval_scope(LCELL(v)[1], 1, scope); }
+    if (form == LFORM_LET) { inner = (lscope){ LCELL(v)[1], 1, 0, 0, scope }; }
+    if ((form == LFORM_EACH || form == LFORM_LOOP) && n == 3 && LTYPE(LCELL(v)[1]) == LVAL_QEXPR &&
+        LCOUNT(LCELL(v)[1]) % 2 == 0 && (form == LFORM_LOOP || LCOUNT(LCELL(v)[1]) == 2)) {
+        inner = lval_scope(LCELL(v)[1], 2, scope);
+    } else if (form == LFORM_EACH || form == LFORM_LOOP) {
+        form = LFORM_OPAQUE;
+    }
+
+    lval* x = NULL;
+    for (int i = 0; i < n; i++) {
+        lval* c = LCELL(v)[i];
+        lval* r;
+        switch (i == 0 ? LFORM_CALL : form) {
+            case LFORM_LAMBDA:
+                r = i == 2 ? lval_resolve_in(c, &inner) : lval_copy(c);
+                break;
+            case LFORM_LET:
+                r = lval_resolve_in(c, &inner);
+                break;
+            case LFORM_BRANCH:
+                r = i == 1 ? lval_resolve_arg(c, scope) : lval_resolve_in(c, scope);
+                break;
+            case LFORM_COND:
+                r = lval_resolve_clause(c, scope);
+                break;
+            case LFORM_WHILE:
+                r = lval_resolve_in(c, scope);
+                break;
+            case LFORM_EACH:
+            case LFORM_LOOP:
+                r = i == 1 ? lval_resolve_binding(c, scope, form) : lval_resolve_in(c, &inner);
+                break;
+            case LFORM_OPAQUE:
+                r = i == 1 ? lval_resolve_arg(c, scope) : lval_copy(c);
+                break;
+            default:
+                r = lval_resolve_arg(c, scope);
+                break;
+        }
+        lval_resolved(v, &x, i, r);
+    }
+
+    return x ? x : lval_copy(v);
+}
+
+lval* lval_resolve(lval* formals, lval* body)
+{
+    /**
+     * Resolution pass run when a lambda is built, and when a loop is
+     * compiled with its names as the formals. References in code to the
+     * formals, to the formals of lambda literals it encloses and to the
+     * variables of its loops are swapped for symbols carrying the frame
+     * depth and slot of their binding. Code is the body, the branches,
+     * bodies and bindings of the special forms and the arguments of
+     * calls that are not Q-Expressions, which may as well be data and
+     * are left alone. Anything else is left for the full lookup.
+     */
+    lscope scope = lval_scope(formals, 1, NULL);
+    lval* x = lval_resolve_in(body, &scope);
+    lval_del(body);
+    return x;
+}
+
+/**
+ * Bind the arguments of lambda f into a fresh frame. A full application
+ * returns NULL and leaves the frame to evaluate the body in, otherwise
+ * the partial application or the error is returned.
+ */
+static void lval_bind_one(lenv* env, lval* f, lval* sym, lval* v)
+{
+    int i = LREPEATS(f) ? lenv_find(env, LSYM(sym)) : -1;
+    if (i >= 0) {
+        lval_del(env->vals[i]);
+        env->vals[i] = v;
     } else {
-        return lval_copy(f);
+        lenv_bind(env, LSYM(sym), v);
     }
 }
 
+static lval* lval_bind(lenv* e, lval* f, lval* a, lenv** frame)
+{
+    lval* formals = LFORMALS(f);
+    int arity = LARITY(f);
+    int bound = LBOUND(f);
+    int given = LCOUNT(a);
+    int rest = LCOUNT(formals) > arity;
+
+    if (arity < 0) {
+        lval_del(a);
+        return lval_err("Function format is invalid. "
+                "Symbol '&' not followed by single symbol.");
+    }
+    if (!rest && given > arity - bound) {
+        lval_del(a);
+        return lval_err("Function passed to many arguments. Got %i, expected %i",
+                given, arity - bound);
+    }
+
+    /**
+     * Bind into a fresh frame in a single pass, the function itself may
+     * be shared. The arguments are moved over rather than copied.
+     */
+    a = lval_unshare(a);
+    int n = min(given, arity - bound);
+    int full = bound + n == arity;
+    lenv* env = lenv_frame(LENV(f), bound + n + (full && rest));
+
+    for (int i = 0; i < n; i++) {
+        lval_bind_one(env, f, LCELL(formals)[bound + i], LCELL(a)[i]);
+    }
+
+    if (full && rest) {
+        lval* more = lval_qexpr();
+        for (int i = n; i < given; i++) {
+            lval_add(more, LCELL(a)[i]);
+        }
+        lval_bind_one(env, f, LCELL(formals)[arity + 1], more);
+    }
+
+    LCOUNT(a) = 0;
+    lval_del(a);
+
+    if (full) {
+        *frame = env;
+        return NULL;
+    }
+
+    /**
+     * Partial application, the frame keeps the arguments supplied so far
+     * and everything else is shared with f. Its frame has the same
+     * layout, so the code of f runs it as well.
+     */
+    lval* p = lval_new(LVAL_FUN);
+    LBUILTIN(p) = NULL;
+    LENV(p) = env;
+    LFORMALS(p) = lval_copy(formals);
+    LBODY(p) = lval_copy(LBODY(f));
+    LCODE(p) = LCODE(f);
+    if (LCODE(p)) { vm_retain(LCODE(p)); }
+    LARITY(p) = arity;
+    LBOUND(p) = bound + n;
+    LREPEATS(p) = LREPEATS(f);
+    return p;
+}
+
 int lval_eq(lval* x, lval* y)
 {
-    if (x->type != y->type) {
+    if (LTYPE(x) != LTYPE(y)) {
         return 0;
     }
 
-    switch (x->type) {
+    switch (LTYPE(x)) {
         case LVAL_NUM:
-            return (x->num == y->num);
+            return (LNUM(x) == LNUM(y));
         case LVAL_STR:
-            return (strcmp(x->str, y->str) == 0);
+            return (strcmp(LSTR(x), LSTR(y)) == 0);
         case LVAL_BOOL:
-            return (x->bool == y->bool);
+            return (LBOOL(x) == LBOOL(y));
         case LVAL_SYM:
-            return (strcmp(x->sym, y->sym) == 0);
+            return LSYM(x) == LSYM(y);
         case LVAL_ERR:
-            return (strcmp(x->err, y->err) == 0);
+            return (strcmp(LERR(x), LERR(y)) == 0);
         case LVAL_FUN:
-            if (x->builtin || y->builtin) {
-                return x->builtin == y->builtin;
+            if (LBUILTIN(x) || LBUILTIN(y)) {
+                return LBUILTIN(x) == LBUILTIN(y);
             } else {
-                return lval_eq(x->formals, y->formals)
-                    && lval_eq(x->body, y->body);
+                return LBOUND(x) == LBOUND(y)
+                    && lval_eq(LFORMALS(x), LFORMALS(y))
+                    && lval_eq(LBODY(x), LBODY(y));
             }
         case LVAL_QEXPR:
         case LVAL_SEXPR:
-            if (x->count != y->count) {
+            if (LCOUNT(x) != LCOUNT(y)) {
                 return 0;
             }
-            for (int i = 0; i < x->count; i++) {
-                if (!(lval_eq(x->cell[i], y->cell[i]))) {
+            for (int i = 0; i < LCOUNT(x); i++) {
+                if (!(lval_eq(LCELL(x)[i], LCELL(y)[i]))) {
                     return 0;
                 }
             }
             return 1;
         break;
+        case LVAL_VEC:
+            return lvec_eq(x, y);
     }
     return 0;
 }
 
 lval* lenv_get(lenv* e, lval* k)
 {
-    /* Iterate over all items in the env */
-    for (int i = 0; i < e->count; i++) {
+    /**
+     * A resolved reference goes straight to its slot, depth frames up,
+     * as long as the layouts it was resolved for still hold. Otherwise
+     * it falls back to the full lookup.
+     */
+    if (LSYMDEPTH(k) >= 0) {
+        if (LSYMVERSION(k) == lenv_layout) {
+            lenv* f = e;
+            for (int d = LSYMDEPTH(k); d > 0; d--) {
+                f = f->par;
+            }
+            assert(LSYMSLOT(k) < f->count && f->syms[LSYMSLOT(k)] == LSYM(k));
+            return lval_copy(f->vals[LSYMSLOT(k)]);
+        }
+    } else if (LSYMVERSION(k) == lenv_version) {
         /**
-         * Check if the stored string matches the symbol string.
-         * If it does, return a copy of the value.
+         * A name never bound in a local frame can only live in the
+         * global environment. Its slot there is cached on the interned
+         * symbol and trusted while no binding was added since.
          */
-        if (strcmp(e->syms[i], k->sym) == 0) {
-            return lval_copy(e->vals[i]);
-        }
+        return lval_copy(lenv_root->vals[LSYMGLOBAL(k)]);
     }
 
-    if (e->par) {
-        return lenv_get(e->par, k);
-    } else {
-        return lval_err("Unbound symbol '%s'", k->sym);
+    /**
+     * Walk up the lexical parents. The global environment ends the
+     * chain, it is searched last.
+     */
+    for (lenv* f = e; f && f != lenv_root; f = f->par) {
+        int i = lenv_find(f, LSYM(k));
+        if (i >= 0) { return lval_copy(f->vals[i]); }
+    }
+
+    int i = lenv_root ? lenv_find(lenv_root, LSYM(k)) : -1;
+    if (i >= 0) {
+        if (!LSYMLOCAL(LSYMINTERN(k))) {
+            LSYMGLOBAL(LSYMINTERN(k)) = i;
+            LSYMVERSION(LSYMINTERN(k)) = lenv_version;
+        }
+        return lval_copy(lenv_root->vals[i]);
     }
+
+    return lval_err("Unbound symbol '%s'", LSYM(k));
 }
 
 void lval_del(lval* v)
 {
-    switch (v->type) {
+    /**
+     * Drop one reference. Values caught in cycles are left for the
+     * collector.
+     */
+    if (LIMM(v) || v->refs == LVAL_IMMORTAL || --v->refs > 0) { return; }
+
+    switch (LTYPE(v)) {
         case LVAL_BOOL:
         case LVAL_DEC:
         case LVAL_NUM:
             break;
         case LVAL_ERR:
-            free(v->err);
+            free(LERR(v));
             break;
         case LVAL_SYM:
-            free(v->sym);
+            /* The name belongs to the interned symbol */
             break;
         case LVAL_STR:
-            free(v->str);
+            free(LSTR(v));
             break;
         case LVAL_QEXPR:
         case LVAL_SEXPR:
-            for (int i = 0; i < v->count; i++) {
-                lval_del(v->cell[i]);
+            if (LVIEW(v)) {
+                lval_del(LOWNER(v));
+                break;
+            }
+            for (int i = 0; i < LCOUNT(v); i++) {
+                lval_del(LCELL(v)[i]);
             }
-            free(v->cell);
+            if (LCELL(v) != LINLINE(v)) { free(LCELL(v)); }
+            break;
+        case LVAL_VEC:
+            if (LVLEFT(v)) { lval_del(LVLEFT(v)); }
+            if (LVITEM(v)) { lval_del(LVITEM(v)); }
+            if (LVRIGHT(v)) { lval_del(LVRIGHT(v)); }
             break;
         case LVAL_FUN:
-            if (!v->builtin) {
-                lenv_del(v->env);
-                lval_del(v->formals);
-                lval_del(v->body);
+            if (!LBUILTIN(v)) {
+                lenv_del(LENV(v));
+                lval_del(LFORMALS(v));
+                lval_del(LBODY(v));
+                if (LCODE(v)) { vm_release(LCODE(v)); }
             }
             break;
     }
-    free(v);
+    pool_free(&lval_pool, v);
 }
 
 void lval_print_str(lval* v)
 {
-    char* escaped = malloc(strlen(v->str) + 1);
+    char* escaped = malloc(strlen(LSTR(v)) + 1);
 
-    strcpy(escaped, v->str);
+    strcpy(escaped, LSTR(v));
 
     escaped = mpcf_escape(escaped);
 
@@ -529,24 +1640,24 @@ void lval_print_str(lval* v)
 
 void lval_print(lval* v)
 {
-    switch (v->type) {
+    switch (LTYPE(v)) {
         case LVAL_NUM:
-            printf("%li", v->num);
+            printf("%li", LNUM(v));
             break;
         case LVAL_DEC:
-            printf("%.*f", get_decimal(), v->decimal);
+            printf("%.*f", get_decimal(), LDEC(v));
             break;
         case LVAL_ERR:
-            printf("Error: %s", v->err);
+            printf("Error: %s", LERR(v));
             break;
         case LVAL_STR:
             lval_print_str(v);
             break;
         case LVAL_BOOL:
-            printf("%s", v->bool ? "true" : "false");
+            printf("%s", LBOOL(v) ? "true" : "false");
             break;
         case LVAL_SYM:
-            printf("%s", v->sym);
+            printf("%s", LSYM(v));
             break;
         case LVAL_SEXPR:
             lval_expr_print(v, '(', ')');
@@ -554,14 +1665,20 @@ void lval_print(lval* v)
         case LVAL_QEXPR:
             lval_expr_print(v, '{', '}');
             break;
+        case LVAL_VEC:
+            lvec_print(v);
+            break;
         case LVAL_FUN:
-            if (v->builtin) {
+            if (LBUILTIN(v)) {
                 printf("<built-in function>");
             } else {
+                /* A partial application only takes the formals left */
                 printf("(\\ ");
-                lval_print(v->formals);
+                lval* formals = lval_slice(LFORMALS(v), LBOUND(v), LCOUNT(LFORMALS(v)));
+                lval_print(formals);
+                lval_del(formals);
                 putchar(' ');
-                lval_print(v->body);
+                lval_print(LBODY(v));
                 putchar(')');
             }
             break;
@@ -577,10 +1694,10 @@ void lval_println(lval* v)
 void lval_expr_print(lval* v, char open, char close)
 {
     putchar(open);
-    for (int i = 0; i < v->count; i++) {
-        lval_print(v->cell[i]);
+    for (int i = 0; i < LCOUNT(v); i++) {
+        lval_print(LCELL(v)[i]);
 
-        if (i != (v->count-1)) {
+        if (i != (LCOUNT(v)-1)) {
             putchar(' ');
         }
     }
@@ -599,6 +1716,7 @@ char* ltype_name(int t)
         case LVAL_SEXPR: return "S-Expression";
         case LVAL_QEXPR: return "Q-Expression";
         case LVAL_BOOL: return "Boolean";
+        case LVAL_VEC: return "Vector";
         default: return "Unknown";
     }
 }
@@ -33,6 +33,7 @@
 #include "structures.h"
 #include "macros.h"
 #include "lenv.h"
+#include "lvec.h"
 #include "lispy.h"
 #include "mpc.h"
 
@@ -52,11 +53,17 @@ lval* lval_bool(int val);
 lval* lval_add(lval* v, lval* x);
 lval* lval_eval(lenv* e, lval* v);
 lval* lval_eval_sexpr(lenv*e, lval* v);
+lval* lval_eval_code(lenv* e, struct lcode* code);
 lval* lval_pop(lval* v, int i);
 lval* lval_take(lval* v, int i);
 lval* lval_join(lval* x, lval* y);
+lval* lval_slice(lval* v, int start, int end);
 lval* lval_copy(lval* v);
-lval* lval_call(lenv* e, lval* f, lval* a);
+lval* lval_unshare(lval* v);
+lval* lval_dup(lval* v);
+lval* lval_escape(lenv* e, lval* v);
+lval* lval_tail(lenv* e, lval* x);
+lval* lval_resolve(lval* formals, lval* body);
 
 lval* lval_read_num(mpc_ast_t* t);
 lval* lval_read_dec(mpc_ast_t* t);
@@ -69,6 +76,8 @@ lval* lenv_get(lenv* e, lval* k);
 int lval_eq(lval* x, lval* y);
 
 void lval_del(lval* v);
+void lval_region_begin(lenv* e);
+void lval_region_end(void);
 void lval_print(lval* v);
 void lval_println(lval* v);
 void lval_print_str(lval* v);
@@ -0,0 +1,299 @@
+/*
+ * Lispy vector source file.
+ *
+ * @filename: lvec.c
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy persistent vector source file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+
+#include "lvec.h"
+#include "lval.h"
+#include "pool.h"
+
+/**
+ * A vector is a join based AVL tree ordered by position. Every node
+ * holds one item and the size of its subtree, which is all that is
+ * needed to find the item at an index. Inside the tree an empty
+ * subtree is NULL, the empty vector itself is a shared immortal node.
+ */
+static lval lvec_empty = { .type = LVAL_VEC, .refs = LVAL_IMMORTAL };
+
+static int size(lval* t) { return t ? LVSIZE(t) : 0; }
+static int height(lval* t) { return t ? LVHEIGHT(t) : 0; }
+
+static lval* retain(lval* t) { return t ? lval_copy(t) : NULL; }
+static void release(lval* t) { if (t) { lval_del(t); } }
+
+/* The tree of a vector value, NULL when it is empty */
+static lval* root(lval* v) { return LVSIZE(v) ? v : NULL; }
+
+/* The vector value for a tree */
+static lval* wrap(lval* t) { return t ? t : &lvec_empty; }
+
+/* New node, takes over the references to l, x and r */
+static lval* node(lval* l, lval* x, lval* r)
+{
+    lval* t = pool_alloc(&lval_pool);
+    t->type = LVAL_VEC;
+    t->is_builtin = 0;
+    t->mark = 0;
+    t->special = 0;
+    t->refs = 1;
+
+    LVLEFT(t) = l;
+    LVITEM(t) = x;
+    LVRIGHT(t) = r;
+    LVSIZE(t) = size(l) + 1 + size(r);
+    LVHEIGHT(t) = 1 + (height(l) > height(r) ? height(l) : height(r));
+    return t;
+}
+
+/**
+ * Rotations build new nodes around the shared grandchildren and drop
+ * the reference to t.
+ */
+static lval* rotate_left(lval* t)
+{
+    lval* r = LVRIGHT(t);
+    lval* n = node(node(retain(LVLEFT(t)), retain(LVITEM(t)), retain(LVLEFT(r))),
+            retain(LVITEM(r)), retain(LVRIGHT(r)));
+    lval_del(t);
+    return n;
+}
+
+static lval* rotate_right(lval* t)
+{
+    lval* l = LVLEFT(t);
+    lval* n = node(retain(LVLEFT(l)), retain(LVITEM(l)),
+            node(retain(LVRIGHT(l)), retain(LVITEM(t)), retain(LVRIGHT(t))));
+    lval_del(t);
+    return n;
+}
+
+static lval* join(lval* l, lval* x, lval* r);
+
+/* l is more than one level taller than r */
+static lval* join_right(lval* l, lval* x, lval* r)
+{
+    lval* ll = retain(LVLEFT(l));
+    lval* lx = retain(LVITEM(l));
+    lval* c = retain(LVRIGHT(l));
+    lval_del(l);
+
+    lval* t;
+    if (height(c) <= height(r) + 1) {
+        t = node(c, x, r);
+        if (height(t) <= height(ll) + 1) { return node(ll, lx, t); }
+        return rotate_left(node(ll, lx, rotate_right(t)));
+    }
+
+    t = join_right(c, x, r);
+    if (height(t) <= height(ll) + 1) { return node(ll, lx, t); }
+    return rotate_left(node(ll, lx, t));
+}
+
+/* r is more than one level taller than l */
+static lval* join_left(lval* l, lval* x, lval* r)
+{
+    lval* c = retain(LVLEFT(r));
+    lval* rx = retain(LVITEM(r));
+    lval* rr = retain(LVRIGHT(r));
+    lval_del(r);
+
+    lval* t;
+    if (height(c) <= height(l) + 1) {
+        t = node(l, x, c);
+        if (height(t) <= height(rr) + 1) { return node(t, rx, rr); }
+        return rotate_right(node(rotate_left(t), rx, rr));
+    }
+
+    t = join_left(l, x, c);
+    if (height(t) <= height(rr) + 1) { return node(t, rx, rr); }
+    return rotate_right(node(t, rx, rr));
+}
+
+/* Everything in l, then x, then everything in r. Consumes all three */
+static lval* join(lval* l, lval* x, lval* r)
+{
+    if (height(l) > height(r) + 1) { return join_right(l, x, r); }
+    if (height(r) > height(l) + 1) { return join_left(l, x, r); }
+    return node(l, x, r);
+}
+
+/* The first k items of t */
+static lval* take(lval* t, int k)
+{
+    if (k <= 0) { return NULL; }
+    if (k >= size(t)) { return retain(t); }
+
+    int sl = size(LVLEFT(t));
+    if (k <= sl) { return take(LVLEFT(t), k); }
+
+    return join(retain(LVLEFT(t)), retain(LVITEM(t)), take(LVRIGHT(t), k - sl - 1));
+}
+
+/* Everything but the first k items of t */
+static lval* drop(lval* t, int k)
+{
+    if (k <= 0) { return retain(t); }
+    if (k >= size(t)) { return NULL; }
+
+    int sl = size(LVLEFT(t));
+    if (k > sl) { return drop(LVRIGHT(t), k - sl - 1); }
+
+    return join(drop(LVLEFT(t), k), retain(LVITEM(t)), retain(LVRIGHT(t)));
+}
+
+static lval* assoc(lval* t, int i, lval* x)
+{
+    int sl = size(LVLEFT(t));
+
+    if (i < sl) {
+        return node(assoc(LVLEFT(t), i, x), retain(LVITEM(t)), retain(LVRIGHT(t)));
+    }
+    if (i > sl) {
+        return node(retain(LVLEFT(t)), retain(LVITEM(t)), assoc(LVRIGHT(t), i - sl - 1, x));
+    }
+    return node(retain(LVLEFT(t)), x, retain(LVRIGHT(t)));
+}
+
+static lval* build(lval** cells, int lo, int hi)
+{
+    if (lo >= hi) { return NULL; }
+
+    int mid = lo + (hi - lo) / 2;
+    return node(build(cells, lo, mid), lval_copy(cells[mid]), build(cells, mid + 1, hi));
+}
+
+static void collect(lval* t, lval* q)
+{
+    if (t == NULL) { return; }
+
+    collect(LVLEFT(t), q);
+    lval_add(q, lval_copy(LVITEM(t)));
+    collect(LVRIGHT(t), q);
+}
+
+lval* lval_vec(void)
+{
+    return &lvec_empty;
+}
+
+lval* lvec_from_expr(lval* q)
+{
+    return wrap(build(LCELL(q), 0, LCOUNT(q)));
+}
+
+lval* lvec_to_qexpr(lval* v)
+{
+    lval* q = lval_qexpr();
+    collect(root(v), q);
+    return q;
+}
+
+int lvec_count(lval* v)
+{
+    return LVSIZE(v);
+}
+
+lval* lvec_nth(lval* v, int i)
+{
+    lval* t = root(v);
+
+    while (t) {
+        int sl = size(LVLEFT(t));
+        if (i == sl) { return LVITEM(t); }
+
+        if (i < sl) {
+            t = LVLEFT(t);
+        } else {
+            i -= sl + 1;
+            t = LVRIGHT(t);
+        }
+    }
+    return NULL;
+}
+
+lval* lvec_assoc(lval* v, int i, lval* x)
+{
+    return assoc(root(v), i, x);
+}
+
+lval* lvec_push(lval* v, lval* x)
+{
+    return join(retain(root(v)), x, NULL);
+}
+
+lval* lvec_slice(lval* v, int start, int end)
+{
+    lval* head = take(root(v), end);
+    lval* t = drop(head, start);
+    release(head);
+    return wrap(t);
+}
+
+lval* lvec_concat(lval* x, lval* y)
+{
+    int n = size(root(x));
+    if (n == 0) { return lval_copy(y); }
+    if (size(root(y)) == 0) { return lval_copy(x); }
+
+    /* The last item of x joins the two trees */
+    return join(take(x, n - 1), lval_copy(lvec_nth(x, n - 1)), lval_copy(y));
+}
+
+int lvec_eq(lval* x, lval* y)
+{
+    if (LVSIZE(x) != LVSIZE(y)) { return 0; }
+
+    for (int i = 0; i < LVSIZE(x); i++) {
+        if (!lval_eq(lvec_nth(x, i), lvec_nth(y, i))) { return 0; }
+    }
+    return 1;
+}
+
+static void print_tree(lval* t, int* first)
+{
+    if (t == NULL) { return; }
+
+    print_tree(LVLEFT(t), first);
+    if (!*first) { putchar(' '); }
+    *first = 0;
+    lval_print(LVITEM(t));
+    print_tree(LVRIGHT(t), first);
+}
+
+void lvec_print(lval* v)
+{
+    int first = 1;
+
+    putchar('[');
+    print_tree(root(v), &first);
+    putchar(']');
+}
@@ -0,0 +1,59 @@
+/**
+ * Lispy vector header file
+ *
+ * @filename: lvec.h
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy persistent vector header file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LSPY_LVEC_HEADER
+#define LSPY_LVEC_HEADER
+
+#include "structures.h"
+
+/**
+ * Vectors are immutable. Every operation leaves its input untouched
+ * and shares all nodes it did not have to change, so nth, assoc, push,
+ * slice and concat all run in O(log n).
+ *
+ * Vector arguments are borrowed, items passed in are consumed, and
+ * every returned vector is a new reference.
+ */
+lval* lval_vec(void);
+lval* lvec_from_expr(lval* q);
+lval* lvec_to_qexpr(lval* v);
+
+int lvec_count(lval* v);
+lval* lvec_nth(lval* v, int i);
+lval* lvec_assoc(lval* v, int i, lval* x);
+lval* lvec_push(lval* v, lval* x);
+lval* lvec_slice(lval* v, int start, int end);
+lval* lvec_concat(lval* x, lval* y);
+
+int lvec_eq(lval* x, lval* y);
+void lvec_print(lval* v);
+#endif
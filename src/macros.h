@@ -39,17 +39,24 @@
     }
 
 #define LASSERT_TYPE(builtin, args, index, expect) \
-    LASSERT(args, args->cell[index]->type == expect, \
+    LASSERT(args, LTYPE(LCELL(args)[index]) == expect, \
             "Function '%s' passed incorrect type for argument %i. Got %s, expected %s.",\
-            builtin, index, ltype_name(args->cell[index]->type), ltype_name(expect))
+            builtin, index, ltype_name(LTYPE(LCELL(args)[index])), ltype_name(expect))
 
 #define LASSERT_NUM(builtin, args, num) \
-    LASSERT(args, args->count == num, \
+    LASSERT(args, LCOUNT(args) == num, \
             "Function '%s' passed incorrect number for arguments. Got %i, expected %i.",\
-            builtin, args->count, num)
+            builtin, LCOUNT(args), num)
+
+#define LASSERT_SEQ(builtin, args, index) \
+    LASSERT(args, LTYPE(LCELL(args)[index]) == LVAL_QEXPR || \
+            LTYPE(LCELL(args)[index]) == LVAL_VEC, \
+            "Function '%s' passed incorrect type for argument %i. Got %s, expected %s or %s.",\
+            builtin, index, ltype_name(LTYPE(LCELL(args)[index])), \
+            ltype_name(LVAL_QEXPR), ltype_name(LVAL_VEC))
 
 #define LASSERT_NOT_EMPTY(builtin, args, index) \
-    LASSERT(args, args->cell[index]->count != 0, \
+    LASSERT(args, LCOUNT(LCELL(args)[index]) != 0, \
             "Function '%s' passed {} for argument %i.",\
             builtin, index)
 #endif
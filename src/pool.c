@@ -0,0 +1,404 @@
+/*
+ * Lispy pool allocator source file.
+ *
+ * @filename: pool.c
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy slab backed pool allocator source file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pool.h"
+#include "structures.h"
+
+struct pool_slab
+{
+    pool_slab* next;
+    int used;
+
+    /* Region slabs are bump allocated and never thread a free list */
+    int region;
+    pool_slab* region_next;
+    pool_slab* spare_next;
+
+    unsigned long live[];
+};
+
+#define LIVE_BITS (8 * sizeof(unsigned long))
+
+pool lval_pool = POOL_INIT("lval", lval);
+pool lenv_pool = POOL_INIT("lenv", lenv);
+
+/**
+ * Nothing above the pool has a way to go on without the object it asked
+ * for, so running out of memory for a slab is the end of the program.
+ */
+static void* pool_exhausted(pool* p)
+{
+    fprintf(stderr, "Out of memory allocating %s objects.\n", p->name);
+    exit(EXIT_FAILURE);
+    return NULL;
+}
+
+#ifdef LSPY_POOL
+static pool_slab* pool_slab_of(void* ptr)
+{
+    return (pool_slab*)((uintptr_t)ptr & ~(uintptr_t)(POOL_SLAB_SIZE - 1));
+}
+
+static int pool_slot_of(pool* p, pool_slab* s, void* ptr)
+{
+    return ((char*)ptr - ((char*)s + p->header)) / p->size;
+}
+
+static void pool_layout(pool* p)
+{
+    size_t align = sizeof(void*);
+    p->size = (p->size + align - 1) & ~(align - 1);
+
+    /* Reserve room for the live bitmap in front of the slots */
+    int per_slab = (POOL_SLAB_SIZE - sizeof(pool_slab)) / p->size;
+    int words = (per_slab + LIVE_BITS - 1) / LIVE_BITS;
+
+    p->header = sizeof(pool_slab) + words * sizeof(unsigned long);
+    p->header = (p->header + align - 1) & ~(align - 1);
+    p->per_slab = (POOL_SLAB_SIZE - p->header) / p->size;
+}
+
+static pool_slab* pool_new_slab(pool* p)
+{
+    if (p->per_slab == 0) { pool_layout(p); }
+
+    void* mem = NULL;
+    if (posix_memalign(&mem, POOL_SLAB_SIZE, POOL_SLAB_SIZE) != 0) { return NULL; }
+
+    pool_slab* s = mem;
+    s->next = p->slabs;
+    s->used = 0;
+    s->region = 0;
+    s->region_next = NULL;
+    s->spare_next = NULL;
+    memset(s->live, 0, p->header - sizeof(pool_slab));
+    p->slabs = s;
+    p->slab_count++;
+    return s;
+}
+
+static void pool_thread(pool* p, pool_slab* s)
+{
+    /* Thread the free slots backwards so they are handed out in address order */
+    char* base = (char*)s + p->header;
+    for (int i = p->per_slab - 1; i >= 0; i--) {
+        if (s->live[i / LIVE_BITS] & (1UL << (i % LIVE_BITS))) { continue; }
+        void** slot = (void**)(base + i * p->size);
+        *slot = p->free_list;
+        p->free_list = slot;
+    }
+}
+
+static void pool_grow(pool* p)
+{
+    pool_slab* s = pool_new_slab(p);
+    if (s) { pool_thread(p, s); }
+}
+
+/**
+ * Move the bump pointer to a slab without live objects, reusing the
+ * current one when everything in it has died already.
+ */
+static int pool_next_bump(pool* p)
+{
+    pool_slab* s = p->bump_slab;
+
+    if (s == NULL || s->used > 0) {
+        if (p->spares) {
+            s = p->spares;
+            p->spares = s->spare_next;
+        } else {
+            s = pool_new_slab(p);
+            if (s == NULL) { return 0; }
+            s->region = 1;
+            s->region_next = p->regions;
+            p->regions = s;
+        }
+    }
+
+    p->bump_slab = s;
+    p->bump = (char*)s + p->header;
+    p->bump_end = p->bump + p->per_slab * p->size;
+    return 1;
+}
+
+void* pool_alloc(pool* p)
+{
+    if (p->region) {
+        if (p->bump == p->bump_end && !pool_next_bump(p)) { return pool_exhausted(p); }
+
+        void* slot = p->bump;
+        p->bump += p->size;
+
+        pool_slab* s = p->bump_slab;
+        int i = pool_slot_of(p, s, slot);
+        s->live[i / LIVE_BITS] |= 1UL << (i % LIVE_BITS);
+        s->used++;
+
+        p->allocs++;
+        if (++p->used > p->peak) { p->peak = p->used; }
+        return slot;
+    }
+
+    if (p->free_list == NULL) {
+        pool_grow(p);
+        if (p->free_list == NULL) { return pool_exhausted(p); }
+    }
+
+    void** slot = p->free_list;
+    p->free_list = *slot;
+
+    pool_slab* s = pool_slab_of(slot);
+    int i = pool_slot_of(p, s, slot);
+    s->live[i / LIVE_BITS] |= 1UL << (i % LIVE_BITS);
+    s->used++;
+
+    p->allocs++;
+    if (++p->used > p->peak) { p->peak = p->used; }
+    return slot;
+}
+
+void pool_free(pool* p, void* ptr)
+{
+    pool_slab* s = pool_slab_of(ptr);
+    int i = pool_slot_of(p, s, ptr);
+    s->live[i / LIVE_BITS] &= ~(1UL << (i % LIVE_BITS));
+    s->used--;
+
+    p->frees++;
+    p->used--;
+
+    if (s->region) {
+        /* A dead region slab is reset as a whole instead of slot by slot */
+        if (s->used == 0) {
+            if (s == p->bump_slab) {
+                p->bump = (char*)s + p->header;
+            } else {
+                s->spare_next = p->spares;
+                p->spares = s;
+            }
+        }
+        return;
+    }
+
+    void** slot = ptr;
+    *slot = p->free_list;
+    p->free_list = slot;
+}
+
+void pool_region_begin(pool* p)
+{
+    p->region++;
+}
+
+/**
+ * Closing the outermost region resets every region slab at once, they
+ * are all kept around for the next region. What is still live in them
+ * by then is garbage, nothing outside a region points into it but what
+ * lval_escape copied out. drop is called on each of those objects to
+ * let go of what they hold outside the region.
+ */
+void pool_region_end(pool* p, void (*drop)(void*))
+{
+    if (--p->region > 0) { return; }
+
+    int words = (p->per_slab + LIVE_BITS - 1) / LIVE_BITS;
+
+    p->spares = NULL;
+    for (pool_slab* s = p->regions; s; s = s->region_next) {
+        if (s->used > 0) {
+            char* base = (char*)s + p->header;
+            for (int w = 0; w < words; w++) {
+                unsigned long bits = s->live[w];
+                while (bits) {
+                    int b = __builtin_ctzl(bits);
+                    bits &= bits - 1;
+                    drop(base + (w * LIVE_BITS + b) * p->size);
+                }
+            }
+            memset(s->live, 0, words * sizeof(unsigned long));
+            p->frees += s->used;
+            p->used -= s->used;
+            s->used = 0;
+        }
+        s->spare_next = p->spares;
+        p->spares = s;
+    }
+
+    p->bump_slab = NULL;
+    p->bump = p->bump_end = NULL;
+}
+
+int pool_in_region(pool* p, void* ptr)
+{
+    (void)p;
+    return pool_slab_of(ptr)->region;
+}
+
+int pool_outlives_region(pool* p, void* ptr)
+{
+    return p->region > 0 && !pool_slab_of(ptr)->region;
+}
+
+void pool_foreach(pool* p, void (*fn)(void*))
+{
+    int words = (p->per_slab + LIVE_BITS - 1) / LIVE_BITS;
+
+    for (pool_slab* s = p->slabs; s; s = s->next) {
+        char* base = (char*)s + p->header;
+        for (int w = 0; w < words; w++) {
+            /* Work on a snapshot, fn is allowed to free the object */
+            unsigned long bits = s->live[w];
+            while (bits) {
+                int b = __builtin_ctzl(bits);
+                bits &= bits - 1;
+                fn(base + (w * LIVE_BITS + b) * p->size);
+            }
+        }
+    }
+}
+
+void pool_print_stats(pool* p)
+{
+    int full = 0, partial = 0, empty = 0, region = 0;
+    long capacity = p->slab_count * p->per_slab;
+
+    for (pool_slab* s = p->slabs; s; s = s->next) {
+        if (s->region) {
+            region++;
+        } else if (s->used == p->per_slab) {
+            full++;
+        } else if (s->used == 0) {
+            empty++;
+        } else {
+            partial++;
+        }
+    }
+
+    printf("%s: %li slabs (%li kB), %li slots of %li bytes, %li in use (%.1f%%), peak %li\n",
+            p->name, p->slab_count, p->slab_count * (POOL_SLAB_SIZE / 1024),
+            capacity, (long)p->size, p->used,
+            capacity ? 100.0 * p->used / capacity : 0.0, p->peak);
+    printf("%*s  slabs full %i, partial %i, empty %i, region %i; %li allocs, %li frees\n",
+            (int)strlen(p->name), "", full, partial, empty, region, p->allocs, p->frees);
+}
+#else
+/**
+ * Without slabs every object carries a small header linking it into
+ * the list of live objects, so the collector can still walk them.
+ */
+typedef struct pool_object
+{
+    struct pool_object* prev;
+    struct pool_object* next;
+    long align;
+} pool_object;
+
+void* pool_alloc(pool* p)
+{
+    pool_object* o = malloc(sizeof(pool_object) + p->size);
+    if (o == NULL) { return pool_exhausted(p); }
+
+    o->prev = NULL;
+    o->next = p->objects;
+    if (o->next) { o->next->prev = o; }
+    p->objects = o;
+
+    p->allocs++;
+    if (++p->used > p->peak) { p->peak = p->used; }
+    return o + 1;
+}
+
+void pool_free(pool* p, void* ptr)
+{
+    pool_object* o = (pool_object*)ptr - 1;
+
+    if (o->prev) {
+        o->prev->next = o->next;
+    } else {
+        p->objects = o->next;
+    }
+    if (o->next) { o->next->prev = o->prev; }
+
+    p->frees++;
+    p->used--;
+    free(o);
+}
+
+void pool_foreach(pool* p, void (*fn)(void*))
+{
+    pool_object* o = p->objects;
+    while (o) {
+        pool_object* next = o->next;
+        fn(o + 1);
+        o = next;
+    }
+}
+
+/* Regions only change how slabs are carved up, there are none here */
+void pool_region_begin(pool* p)
+{
+    p->region++;
+}
+
+void pool_region_end(pool* p, void (*drop)(void*))
+{
+    (void)drop;
+    p->region--;
+}
+
+int pool_in_region(pool* p, void* ptr)
+{
+    (void)p;
+    (void)ptr;
+    return 0;
+}
+
+int pool_outlives_region(pool* p, void* ptr)
+{
+    (void)p;
+    (void)ptr;
+    return 0;
+}
+
+void pool_print_stats(pool* p)
+{
+    printf("%s: plain malloc, %li in use, peak %li; %li allocs, %li frees\n",
+            p->name, p->used, p->peak, p->allocs, p->frees);
+}
+#endif
@@ -0,0 +1,98 @@
+/**
+ * Lispy pool allocator header file
+ *
+ * @filename: pool.h
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy slab backed pool allocator header file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LSPY_POOL_HEADER
+#define LSPY_POOL_HEADER
+
+#include <stdlib.h>
+
+/**
+ * Every slab is a single aligned block, so the slab owning an object
+ * can be found by masking the object address.
+ */
+#define POOL_SLAB_SIZE (64 * 1024)
+
+typedef struct pool_slab pool_slab;
+
+typedef struct
+{
+    char* name;
+    size_t size;
+
+    /* Slab layout, computed on first allocation */
+    int per_slab;
+    size_t header;
+
+    pool_slab* slabs;
+    void* free_list;
+    void* objects;
+
+    /**
+     * Region mode, see pool_region_begin. While region is non zero
+     * objects are bump allocated from region slabs instead of being
+     * taken from the free list.
+     */
+    int region;
+    pool_slab* regions;
+    pool_slab* spares;
+    pool_slab* bump_slab;
+    char* bump;
+    char* bump_end;
+
+    /* Statistics */
+    long slab_count;
+    long used;
+    long peak;
+    long allocs;
+    long frees;
+} pool;
+
+#define POOL_INIT(name, type) { name, sizeof(type), 0, 0, NULL, NULL, NULL, \
+    0, NULL, NULL, NULL, NULL, NULL, 0, 0, 0, 0, 0 }
+
+extern pool lval_pool;
+extern pool lenv_pool;
+
+void* pool_alloc(pool* p);
+void pool_free(pool* p, void* ptr);
+void pool_foreach(pool* p, void (*fn)(void*));
+void pool_region_begin(pool* p);
+void pool_region_end(pool* p, void (*drop)(void*));
+int pool_in_region(pool* p, void* ptr);
+
+/**
+ * Whether ptr was allocated before the open region, so that it lives on
+ * after the region is reset and must not be made to point into it.
+ */
+int pool_outlives_region(pool* p, void* ptr);
+void pool_print_stats(pool* p);
+#endif
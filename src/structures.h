@@ -32,45 +32,219 @@
 
 #ifndef LSPY_STRUCTURES
 #define LSPY_STRUCTURES
+
+#include <stdint.h>
+
 struct lval;
 struct lenv;
+struct lcode;
 typedef struct lval lval;
 typedef struct lenv lenv;
 typedef lval*(*lbuiltin)(lenv*, lval*);
 
+/**
+ * Builtins may also have an entry taking the argument count and an
+ * array of arguments. The arguments are borrowed, so the caller can
+ * pass them straight from wherever it keeps them.
+ */
+typedef lval*(*lbuiltinv)(lenv*, int, lval**);
+
 enum { LVAL_ERR, LVAL_NUM, LVAL_DEC, LVAL_SYM,
     LVAL_STR, LVAL_FUN, LVAL_SEXPR, LVAL_QEXPR,
-    LVAL_BOOL};
+    LVAL_BOOL, LVAL_VEC};
 
+/**
+ * Reference count of values that are allocated once and never freed,
+ * the booleans and a few more shared ones.
+ */
+#define LVAL_IMMORTAL 0x7fffffff
+
+/**
+ * Numbers are immediate, kept in the pointer itself instead of a value
+ * it points at. Values are at least 8 byte aligned, so a pointer with
+ * one of its two low bits set is no value but a number: an integer
+ * shifted up by one when the lowest bit is set, a decimal in the bits
+ * above when they read 10. Integers of up to 63 bits fit, as do the
+ * decimals lval_dec can squeeze into 62, anything larger is allocated
+ * like other values. Nothing is read through a pointer before LIMM
+ * says it is one, LTYPE, LNUM and LDEC see to that.
+ */
+#define LVAL_IMM_INT 1
+#define LVAL_IMM_DEC 2
+#define LIMM(v) ((uintptr_t)(v) & 3)
+
+double lval_imm_dec(lval* v);
+
+/* Cells an expression keeps inside the value before spilling to the heap */
+#ifndef LVAL_INLINE_CELLS
+#define LVAL_INLINE_CELLS 4
+#endif
+
+/**
+ * Only one payload is live for any type, so they overlay each other.
+ * A value is 56 bytes on 64 bit targets, short expressions being the
+ * largest since they keep their first cells inline.
+ * Go through the accessors below rather than the union members.
+ */
 struct lval
 {
-    int type;
-    int is_builtin;
-
-    /* Basics */
-    long num;
-    double decimal;
-    char* err;
-    char* sym;
-    char* str;
-    int bool;
-
-    /* Functions */
-    lbuiltin builtin;
-    lenv* env;
-    lval* formals;
-    lval* body;
-
-    /* Expressions */
-    int count;
-    lval** cell;
+    unsigned char type;
+    unsigned char is_builtin;
+    unsigned char mark;
+
+    /* Builtins taking their arguments unevaluated, the special forms */
+    unsigned char special;
+    int refs;
+
+    union
+    {
+        /* Basics */
+        long num;
+        double decimal;
+        char* err;
+        char* str;
+        int bool;
+
+        /**
+         * Symbols. References resolved by lval_resolve also carry the
+         * frame depth and slot their binding is expected at, interned
+         * symbols have a depth of -1. Interned symbols cache the slot
+         * of their global binding, valid while version matches
+         * lenv_version, and note whether the name was ever bound in a
+         * local frame, or rebound with def or =. What resolved symbols
+         * rely on is noted as well, see lenv_layout.
+         */
+        struct
+        {
+            char* name;
+            lval* intern;
+            int depth;
+            int slot;
+            int global;
+            unsigned int version;
+            unsigned int local : 1;
+            unsigned int rebound : 1;
+            unsigned int trusted : 1;
+            unsigned int outer : 1;
+            unsigned int shadowed : 1;
+        } sym;
+
+        /**
+         * Functions, lambdas may carry their body compiled for the vm.
+         * A lambda knows the number of formals before '&', how many of
+         * them a partial application has bound in env already and
+         * whether any name is repeated among them.
+         */
+        struct
+        {
+            lbuiltin builtin;
+            lenv* env;
+            lval* formals;
+            lval* body;
+            struct lcode* code;
+            union
+            {
+                lbuiltinv builtinv;
+                struct
+                {
+                    int arity;
+                    unsigned int bound : 31;
+                    unsigned int repeats : 1;
+                } args;
+            } call;
+        } fun;
+
+        /**
+         * Expressions, cell points at inl until they outgrow it. A view
+         * has no capacity of its own, its cells are a window into the
+         * buffer of owner and are not counted as references.
+         */
+        struct
+        {
+            int count;
+            int cap;
+            lval** cell;
+            union
+            {
+                lval* inl[LVAL_INLINE_CELLS];
+                lval* owner;
+            } store;
+        } expr;
+
+        /* Vectors, a balanced tree with one item in every node */
+        struct
+        {
+            int size;
+            int height;
+            lval* left;
+            lval* item;
+            lval* right;
+        } vec;
+    } as;
 };
 
+#define LTYPE(v) (LIMM(v) ? (LIMM(v) & LVAL_IMM_INT ? LVAL_NUM : LVAL_DEC) : (v)->type)
+#define LNUM(v) (LIMM(v) ? (long)((intptr_t)(v) >> 1) : (v)->as.num)
+#define LDEC(v) (LIMM(v) ? lval_imm_dec(v) : (v)->as.decimal)
+#define LERR(v) ((v)->as.err)
+#define LSYM(v) ((v)->as.sym.name)
+#define LSYMDEPTH(v) ((v)->as.sym.depth)
+#define LSYMSLOT(v) ((v)->as.sym.slot)
+#define LSYMINTERN(v) ((v)->as.sym.intern)
+#define LSYMGLOBAL(v) ((v)->as.sym.global)
+#define LSYMVERSION(v) ((v)->as.sym.version)
+#define LSYMLOCAL(v) ((v)->as.sym.local)
+#define LSYMREBOUND(v) ((v)->as.sym.rebound)
+#define LSYMTRUSTED(v) ((v)->as.sym.trusted)
+#define LSYMOUTER(v) ((v)->as.sym.outer)
+#define LSYMSHADOWED(v) ((v)->as.sym.shadowed)
+#define LSTR(v) ((v)->as.str)
+#define LBOOL(v) ((v)->as.bool)
+#define LBUILTIN(v) ((v)->as.fun.builtin)
+#define LBUILTINV(v) ((v)->as.fun.call.builtinv)
+#define LSPECIAL(v) (!LIMM(v) && (v)->special)
+#define LENV(v) ((v)->as.fun.env)
+#define LFORMALS(v) ((v)->as.fun.formals)
+#define LBODY(v) ((v)->as.fun.body)
+#define LCODE(v) ((v)->as.fun.code)
+#define LARITY(v) ((v)->as.fun.call.args.arity)
+#define LBOUND(v) ((v)->as.fun.call.args.bound)
+#define LREPEATS(v) ((v)->as.fun.call.args.repeats)
+#define LCOUNT(v) ((v)->as.expr.count)
+#define LCELL(v) ((v)->as.expr.cell)
+#define LCAP(v) ((v)->as.expr.cap)
+#define LINLINE(v) ((v)->as.expr.store.inl)
+#define LOWNER(v) ((v)->as.expr.store.owner)
+#define LVIEW(v) (LCAP(v) == 0)
+#define LVSIZE(v) ((v)->as.vec.size)
+#define LVHEIGHT(v) ((v)->as.vec.height)
+#define LVLEFT(v) ((v)->as.vec.left)
+#define LVITEM(v) ((v)->as.vec.item)
+#define LVRIGHT(v) ((v)->as.vec.right)
+
+/**
+ * Bindings are kept in insertion order. Once an environment outgrows
+ * LENV_LINEAR bindings it also gets a hash index over the names,
+ * smaller frames are searched linearly.
+ */
+#ifndef LENV_LINEAR
+#define LENV_LINEAR 8
+#endif
+
+struct hash_index;
+
+/**
+ * par is the lexical parent, the environment a lambda was built in,
+ * and is owned. Lookups go up the parents and nowhere else.
+ */
 struct lenv
 {
+    int mark;
+    int refs;
     lenv* par;
     int count;
     char** syms;
     lval** vals;
+    struct hash_index* index;
 };
 #endif
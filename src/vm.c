@@ -0,0 +1,518 @@
+/*
+ * Lispy vm source file.
+ *
+ * @filename: vm.c
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy bytecode compiler and vm source file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <assert.h>
+
+#include "vm.h"
+#include "lval.h"
+#include "builtins.h"
+#include "fold.h"
+
+/* Dispatch through a table of label addresses where the compiler can */
+#if defined(__GNUC__) && !defined(VM_SWITCH)
+#define VM_THREADED
+#endif
+
+/**
+ * Opcodes and their operands. Every S-Expression of the body pushes the
+ * values of its cells and ends in CALL or TAIL, which hand the call back
+ * to the evaluator. Arithmetic, comparisons and if have opcodes of their
+ * own that work in place when the operator is the builtin the name is
+ * normally bound to and the operands are plain integers, and otherwise
+ * fall back to a call with the same arguments. Any other call checks
+ * the operator once it is known, a special form gets the cells of the
+ * expression as they are instead of their values. The guard of a call
+ * inlined by fold.c is checked in place as well.
+ *
+ * What each cell is, a constant, a reference into the frame, a global,
+ * a call or an if, is settled once when the lambda is built. Running
+ * the body does not copy it or look at the type of its cells again. A
+ * body only known at run time, a Q-Expression given to eval or a branch
+ * computed by a call, is walked by the evaluator instead.
+ */
+enum
+{
+    OP_CONST,   /* const */
+    OP_LOCAL,   /* slot, const */
+    OP_LOAD,    /* const */
+    OP_CALL,    /* count */
+    OP_TAIL,    /* count */
+    OP_IF,      /* else, end, then branch, else branch, tail, condition */
+    OP_JMP,     /* target */
+    OP_FORM,    /* arguments, end, tail */
+    OP_GUARD,   /* names, else */
+    OP_RETURN,
+    OP_ADD,     /* tail, for all of the below */
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_EQ,
+    OP_NE,
+    OP_GT,
+    OP_LT,
+    OP_GE,
+    OP_LE,
+    OP_INC,
+    OP_DEC
+};
+
+static struct
+{
+    char* name;
+    int argc;
+    int op;
+} vm_prims[] = {
+    { "+", 2, OP_ADD },
+    { "-", 2, OP_SUB },
+    { "*", 2, OP_MUL },
+    { "/", 2, OP_DIV },
+    { "%", 2, OP_MOD },
+    { "==", 2, OP_EQ },
+    { "!=", 2, OP_NE },
+    { ">", 2, OP_GT },
+    { "<", 2, OP_LT },
+    { ">=", 2, OP_GE },
+    { "<=", 2, OP_LE },
+    { "++", 1, OP_INC },
+    { "--", 1, OP_DEC },
+};
+
+static void vm_emit(lcode* c, int op)
+{
+    if (c->count == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 32;
+        c->ops = realloc(c->ops, sizeof(int) * c->cap);
+    }
+    c->ops[c->count++] = op;
+}
+
+static int vm_const(lcode* c, lval* v)
+{
+    lval_add(c->consts, lval_copy(v));
+    return LCOUNT(c->consts) - 1;
+}
+
+static int vm_prim(lval* head, int argc)
+{
+    if (LTYPE(head) != LVAL_SYM) { return -1; }
+
+    for (int i = 0; i < sizeof(vm_prims) / sizeof(vm_prims[0]); i++) {
+        if (vm_prims[i].argc == argc && strcmp(vm_prims[i].name, LSYM(head)) == 0) {
+            return vm_prims[i].op;
+        }
+    }
+    return -1;
+}
+
+static void vm_compile_sexpr(lcode* c, lval* v, int tail);
+
+static void vm_compile_value(lcode* c, lval* v)
+{
+    switch (LTYPE(v)) {
+        case LVAL_SYM:
+            /* References resolved to the frame of the lambda itself */
+            if (LSYMDEPTH(v) == 0) {
+                vm_emit(c, OP_LOCAL);
+                vm_emit(c, LSYMSLOT(v));
+            } else {
+                vm_emit(c, OP_LOAD);
+            }
+            vm_emit(c, vm_const(c, v));
+            break;
+        case LVAL_SEXPR:
+            vm_compile_sexpr(c, v, 0);
+            break;
+        default:
+            vm_emit(c, OP_CONST);
+            vm_emit(c, vm_const(c, v));
+            break;
+    }
+}
+
+/**
+ * (if cond {then} {else}) tests the condition in place and runs the
+ * branches inline, in the position of the if itself.
+ */
+static void vm_compile_if(lcode* c, lval* v, int tail)
+{
+    vm_compile_value(c, LCELL(v)[0]);
+    vm_compile_value(c, LCELL(v)[1]);
+
+    vm_emit(c, OP_IF);
+    int at = c->count;
+    vm_emit(c, 0);
+    vm_emit(c, 0);
+    vm_emit(c, vm_const(c, LCELL(v)[2]));
+    vm_emit(c, vm_const(c, LCELL(v)[3]));
+    vm_emit(c, tail);
+    vm_emit(c, vm_const(c, LCELL(v)[1]));
+
+    vm_compile_sexpr(c, LCELL(v)[2], tail);
+    vm_emit(c, OP_JMP);
+    int jmp = c->count;
+    vm_emit(c, 0);
+
+    c->ops[at] = c->count;
+    vm_compile_sexpr(c, LCELL(v)[3], tail);
+    c->ops[at + 1] = c->count;
+    c->ops[jmp] = c->count;
+}
+
+/* (guard {names} {inlined} {call}) runs either branch inline as well */
+static void vm_compile_guard(lcode* c, lval* v, int tail)
+{
+    vm_emit(c, OP_GUARD);
+    vm_emit(c, vm_const(c, LCELL(v)[1]));
+    int at = c->count;
+    vm_emit(c, 0);
+
+    vm_compile_sexpr(c, LCELL(v)[2], tail);
+    vm_emit(c, OP_JMP);
+    int jmp = c->count;
+    vm_emit(c, 0);
+
+    c->ops[at] = c->count;
+    vm_compile_sexpr(c, LCELL(v)[3], tail);
+    c->ops[jmp] = c->count;
+}
+
+static void vm_compile_sexpr(lcode* c, lval* v, int tail)
+{
+    int n = LCOUNT(v);
+
+    if (n == 4 && fold_guarded(LCELL(v)[0]) && LTYPE(LCELL(v)[1]) == LVAL_QEXPR &&
+        LTYPE(LCELL(v)[2]) == LVAL_QEXPR && LTYPE(LCELL(v)[3]) == LVAL_QEXPR) {
+        vm_compile_guard(c, v, tail);
+        return;
+    }
+
+    if (n == 4 && LTYPE(LCELL(v)[0]) == LVAL_SYM && strcmp(LSYM(LCELL(v)[0]), "if") == 0 &&
+        LTYPE(LCELL(v)[2]) == LVAL_QEXPR && LTYPE(LCELL(v)[3]) == LVAL_QEXPR) {
+        vm_compile_if(c, v, tail);
+        return;
+    }
+
+    int op = n > 1 ? vm_prim(LCELL(v)[0], n - 1) : -1;
+    int form = -1;
+
+    for (int i = 0; i < n; i++) {
+        vm_compile_value(c, LCELL(v)[i]);
+
+        if (i == 0 && n > 1 && op < 0) {
+            lval* args = lval_slice(v, 1, n);
+            vm_emit(c, OP_FORM);
+            vm_emit(c, vm_const(c, args));
+            lval_del(args);
+            form = c->count;
+            vm_emit(c, 0);
+            vm_emit(c, tail);
+        }
+    }
+
+    if (op >= 0) {
+        vm_emit(c, op);
+        vm_emit(c, tail);
+    } else {
+        vm_emit(c, tail ? OP_TAIL : OP_CALL);
+        vm_emit(c, n);
+    }
+    if (form >= 0) { c->ops[form] = c->count; }
+}
+
+lcode* vm_compile(lval* body)
+{
+    lcode* c = malloc(sizeof(lcode));
+    c->refs = 1;
+    c->consts = lval_qexpr();
+    c->count = 0;
+    c->cap = 0;
+    c->ops = NULL;
+
+    /* The body is evaluated as an S-Expression, in tail position */
+    vm_compile_sexpr(c, body, 1);
+    vm_emit(c, OP_RETURN);
+    return c;
+}
+
+void vm_retain(lcode* c)
+{
+    c->refs++;
+}
+
+void vm_release(lcode* c)
+{
+    if (--c->refs > 0) { return; }
+
+    lval_del(c->consts);
+    free(c->ops);
+    free(c);
+}
+
+static int vm_is(lval* f, lbuiltin fn)
+{
+    return LTYPE(f) == LVAL_FUN && LBUILTIN(f) == fn;
+}
+
+/* Move the top n values of the stack into a fresh argument list */
+static lval* vm_args(lval* s, int n)
+{
+    lval* a = lval_sexpr();
+    int base = LCOUNT(s) - n;
+    for (int i = base; i < LCOUNT(s); i++) {
+        lval_add(a, LCELL(s)[i]);
+    }
+    LCOUNT(s) = base;
+    return a;
+}
+
+static void vm_drop(lval* s, int n)
+{
+    while (n--) {
+        lval_del(LCELL(s)[--LCOUNT(s)]);
+    }
+}
+
+#define TOP(i) (LCELL(s)[LCOUNT(s) - 1 - (i)])
+
+/* Whether any of the top n values is an error, which the evaluator reports */
+static int vm_errors(lval* s, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (LTYPE(TOP(i)) == LVAL_ERR) { return 1; }
+    }
+    return 0;
+}
+
+/* An operator on two integers, the result replaces operator and operands */
+#define VM_BINOP(fn, ok, result) { \
+    lval* f = TOP(2); \
+    lval* x = TOP(1); \
+    lval* y = TOP(0); \
+    if (vm_is(f, fn) && LTYPE(x) == LVAL_NUM && LTYPE(y) == LVAL_NUM && (ok)) { \
+        lval* r = (result); \
+        vm_drop(s, 3); \
+        lval_add(s, r); \
+        pc++; \
+        VM_NEXT; \
+    } \
+    n = 3; \
+    tail = *pc++; \
+    goto call; \
+}
+
+int vm_run(lcode* c, int* pcp, lenv* e, lval* s, lval** out)
+{
+    int* pc = c->ops + *pcp;
+    lval** consts = LCELL(c->consts);
+    int n, tail;
+
+#ifdef VM_THREADED
+    static void* labels[] = {
+        &&L_OP_CONST, &&L_OP_LOCAL, &&L_OP_LOAD, &&L_OP_CALL, &&L_OP_TAIL,
+        &&L_OP_IF, &&L_OP_JMP, &&L_OP_FORM, &&L_OP_GUARD, &&L_OP_RETURN, &&L_OP_ADD, &&L_OP_SUB,
+        &&L_OP_MUL, &&L_OP_DIV, &&L_OP_MOD, &&L_OP_EQ, &&L_OP_NE,
+        &&L_OP_GT, &&L_OP_LT, &&L_OP_GE, &&L_OP_LE, &&L_OP_INC, &&L_OP_DEC
+    };
+#define VM_CASE(op) L_##op:
+#define VM_NEXT goto *labels[*pc++]
+    VM_NEXT;
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT goto dispatch
+dispatch:
+    switch (*pc++) {
+#endif
+
+    VM_CASE(OP_CONST) {
+        lval_add(s, lval_copy(consts[pc[0]]));
+        pc += 1;
+        VM_NEXT;
+    }
+
+    VM_CASE(OP_LOCAL) {
+        /* What lenv_get does for a reference into this frame */
+        int slot = pc[0];
+        lval* k = consts[pc[1]];
+        pc += 2;
+        if (LSYMVERSION(k) == lenv_layout) {
+            assert(slot < e->count && e->syms[slot] == LSYM(k));
+            lval_add(s, lval_copy(e->vals[slot]));
+        } else {
+            lval_add(s, lenv_get(e, k));
+        }
+        VM_NEXT;
+    }
+
+    VM_CASE(OP_LOAD) {
+        lval_add(s, lenv_get(e, consts[pc[0]]));
+        pc += 1;
+        VM_NEXT;
+    }
+
+    VM_CASE(OP_CALL) {
+        n = *pc++;
+        tail = 0;
+        goto call;
+    }
+
+    VM_CASE(OP_TAIL) {
+        n = *pc++;
+        tail = 1;
+        goto call;
+    }
+
+    VM_CASE(OP_IF) {
+        lval* f = TOP(1);
+        lval* x = TOP(0);
+        if (vm_is(f, builtin_if) && (LTYPE(x) == LVAL_BOOL || LTYPE(x) == LVAL_NUM)) {
+            int pick = LTYPE(x) == LVAL_BOOL ? LBOOL(x) : LNUM(x) > 0;
+            vm_drop(s, 2);
+            pc = pick ? pc + 6 : c->ops + pc[0];
+            VM_NEXT;
+        }
+
+        /**
+         * Not the builtin, or it would fail, call it with the branches.
+         * Another special form evaluates the condition itself.
+         */
+        if (LSPECIAL(f) && !vm_is(f, builtin_if)) {
+            lval_del(x);
+            TOP(0) = lval_copy(consts[pc[5]]);
+        }
+        lval_add(s, lval_copy(consts[pc[2]]));
+        lval_add(s, lval_copy(consts[pc[3]]));
+        n = 4;
+        tail = pc[4];
+        pc = c->ops + pc[1];
+        goto call;
+    }
+
+    VM_CASE(OP_GUARD) {
+        pc = fold_stable(consts[pc[0]]) ? pc + 2 : c->ops + pc[1];
+        VM_NEXT;
+    }
+
+    VM_CASE(OP_JMP) {
+        pc = c->ops + pc[0];
+        VM_NEXT;
+    }
+
+    VM_CASE(OP_FORM) {
+        if (!LSPECIAL(TOP(0))) {
+            pc += 3;
+            VM_NEXT;
+        }
+
+        lval* args = consts[pc[0]];
+        for (int i = 0; i < LCOUNT(args); i++) {
+            lval_add(s, lval_copy(LCELL(args)[i]));
+        }
+        n = LCOUNT(args) + 1;
+        tail = pc[2];
+        pc = c->ops + pc[1];
+        goto call;
+    }
+
+    VM_CASE(OP_RETURN) {
+        *out = TOP(0);
+        LCOUNT(s)--;
+        return VM_RETURN;
+    }
+
+    VM_CASE(OP_ADD) VM_BINOP(builtin_add, 1, lval_num(LNUM(x) + LNUM(y)))
+    VM_CASE(OP_SUB) VM_BINOP(builtin_sub, 1, lval_num(LNUM(x) - LNUM(y)))
+    VM_CASE(OP_MUL) VM_BINOP(builtin_mul, 1, lval_num(LNUM(x) * LNUM(y)))
+    VM_CASE(OP_DIV) VM_BINOP(builtin_div, LNUM(y) != 0, lval_num(LNUM(x) / LNUM(y)))
+    VM_CASE(OP_MOD) VM_BINOP(builtin_mod, LNUM(y) != 0, lval_num(LNUM(x) % LNUM(y)))
+    VM_CASE(OP_EQ) VM_BINOP(builtin_eq, 1, lval_bool(LNUM(x) == LNUM(y)))
+    VM_CASE(OP_NE) VM_BINOP(builtin_ne, 1, lval_bool(LNUM(x) != LNUM(y)))
+    VM_CASE(OP_GT) VM_BINOP(builtin_gt, 1, lval_bool(LNUM(x) > LNUM(y)))
+    VM_CASE(OP_LT) VM_BINOP(builtin_lt, 1, lval_bool(LNUM(x) < LNUM(y)))
+
+    /* As the builtins bound to >= and <= compare */
+    VM_CASE(OP_GE) VM_BINOP(builtin_ge, 1, lval_bool(LNUM(x) <= LNUM(y)))
+    VM_CASE(OP_LE) VM_BINOP(builtin_le, 1, lval_bool(LNUM(x) >= LNUM(y)))
+
+    VM_CASE(OP_INC) {
+        lval* f = TOP(1);
+        lval* x = TOP(0);
+        if (vm_is(f, builtin_inc) && LTYPE(x) == LVAL_NUM) {
+            int r = LNUM(x) + 1;
+            vm_drop(s, 2);
+            lval_add(s, lval_num(r));
+            pc++;
+            VM_NEXT;
+        }
+        n = 2;
+        tail = *pc++;
+        goto call;
+    }
+
+    VM_CASE(OP_DEC) {
+        lval* f = TOP(1);
+        lval* x = TOP(0);
+        if (vm_is(f, builtin_dec) && LTYPE(x) == LVAL_NUM) {
+            int r = LNUM(x) - 1;
+            vm_drop(s, 2);
+            lval_add(s, lval_num(r));
+            pc++;
+            VM_NEXT;
+        }
+        n = 2;
+        tail = *pc++;
+        goto call;
+    }
+
+#ifndef VM_THREADED
+    }
+#endif
+
+call:
+    /* A single value that does not evaluate any further is the result */
+    if (n == 1 && LTYPE(TOP(0)) != LVAL_SEXPR) {
+        VM_NEXT;
+    }
+
+    /* Builtins taking an argument array run on the operands in place */
+    lval* f = TOP(n - 1);
+    if (n > 1 && LTYPE(f) == LVAL_FUN && LBUILTIN(f) && LBUILTINV(f) && !vm_errors(s, n - 1)) {
+        lval* r = LBUILTINV(f)(e, n - 1, &TOP(n - 2));
+        vm_drop(s, n);
+        lval_add(s, r);
+        VM_NEXT;
+    }
+
+    *out = vm_args(s, n);
+    *pcp = pc - c->ops;
+    return tail ? VM_TAIL : VM_CALL;
+}
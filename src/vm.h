@@ -0,0 +1,67 @@
+/**
+ * Lispy vm header file
+ *
+ * @filename: vm.h
+ *
+ * @version: 0.18
+ *
+ * @date: 2026-10-18
+ *
+ * @description: Lispy bytecode compiler and vm header file.
+ *
+ * @author: Alexander Skjolden
+ *
+ * @webpage: https://github.com/plastboks/Lispy
+ *
+ * This file is part of Lispy.
+ *
+ * Lispy is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Lispy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Lispy.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LSPY_VM_HEADER
+#define LSPY_VM_HEADER
+
+#include "structures.h"
+
+/**
+ * A lambda body compiled to bytecode. The constants are the symbols,
+ * literals and branches of the body, kept in a Q-Expression so the
+ * collector and region promotion treat them like any other value.
+ * Partial applications and copies of a lambda share its code.
+ */
+typedef struct lcode
+{
+    int refs;
+    lval* consts;
+    int count;
+    int cap;
+    int* ops;
+} lcode;
+
+/* What vm_run stopped for */
+enum { VM_RETURN, VM_CALL, VM_TAIL };
+
+lcode* vm_compile(lval* body);
+void vm_retain(lcode* c);
+void vm_release(lcode* c);
+
+/**
+ * Run code from *pc in environment e, with s as the operand stack.
+ * Returns VM_RETURN with the value of the body in *out, or VM_CALL and
+ * VM_TAIL with an argument list for the evaluator to apply, in which
+ * case *pc is where to resume once the result is pushed on s.
+ */
+int vm_run(lcode* c, int* pc, lenv* e, lval* s, lval** out);
+#endif